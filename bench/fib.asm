@@ -0,0 +1,28 @@
+;; set r1 to fib(n) by plain recursion, with the stack in r6
+	.ORIG $3000
+	LD	r6	stack
+	LD	r0	n
+	JSR	fib
+	HALT
+;; r1 = fib(r0), keeping r0
+fib:	ADD	r1	r0	#-2
+	BRzp	rec
+	ADD	r1	r0	#0
+	RET
+rec:	ADD	r6	r6	#-3
+	STR	r7	r6	#0
+	STR	r0	r6	#1
+	ADD	r0	r0	#-1
+	JSR	fib
+	STR	r1	r6	#2
+	ADD	r0	r0	#-1
+	JSR	fib
+	LDR	r2	r6	#2
+	ADD	r1	r1	r2
+	LDR	r0	r6	#1
+	LDR	r7	r6	#0
+	ADD	r6	r6	#3
+	RET
+n:	.FILL	#25
+stack:	.FILL	$8000
+	.END
@@ -0,0 +1,26 @@
+;; copy a 4K-word block four words at a time, rounds times
+	.ORIG $3000
+	LD	r6	rounds
+round:	LD	r1	source
+	LD	r2	target
+	LD	r3	count
+copy:	LDR	r0	r1	#0
+	STR	r0	r2	#0
+	LDR	r0	r1	#1
+	STR	r0	r2	#1
+	LDR	r0	r1	#2
+	STR	r0	r2	#2
+	LDR	r0	r1	#3
+	STR	r0	r2	#3
+	ADD	r1	r1	#4
+	ADD	r2	r2	#4
+	ADD	r3	r3	#-1
+	BRp	copy
+	ADD	r6	r6	#-1
+	BRp	round
+	HALT
+rounds:	.FILL	#200
+source:	.FILL	$4000
+target:	.FILL	$6000
+count:	.FILL	#1024
+	.END
@@ -0,0 +1,19 @@
+;; print a line of text and a digit, lines times
+	.ORIG $3000
+	LD	r5	lines
+line:	LEA	r0	text
+	PUTS
+	AND	r0	r5	#7
+	LD	r1	zero
+	ADD	r0	r0	r1
+	OUT
+	LD	r0	newline
+	OUT
+	ADD	r5	r5	#-1
+	BRp	line
+	HALT
+lines:	.FILL	#20000
+zero:	.FILL	$30
+newline:	.FILL	#10
+text:	.STRINGZ "the quick brown fox jumps over the lazy dog "
+	.END
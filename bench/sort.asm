@@ -0,0 +1,49 @@
+;; fill an array with pseudo-random numbers and insertion-sort it, rounds times
+	.ORIG $3000
+	LD	r6	rounds
+round:	LEA	r1	array
+	LD	r2	count
+	LD	r3	seed
+	LD	r7	mask
+fill:	ADD	r4	r3	r3
+	ADD	r4	r4	r4
+	ADD	r3	r4	r3
+	ADD	r3	r3	#13
+	AND	r3	r3	r7
+	STR	r3	r1	#0
+	ADD	r1	r1	#1
+	ADD	r2	r2	#-1
+	BRp	fill
+	ST	r3	seed
+	LD	r2	count
+	ADD	r2	r2	#-1
+	ST	r2	left
+	LEA	r1	array
+	ADD	r1	r1	#1
+outer:	LDR	r3	r1	#0
+	NOT	r7	r3
+	ADD	r7	r7	#1
+	ADD	r4	r1	#-1
+inner:	LDR	r5	r4	#0
+	ADD	r2	r5	r7
+	BRnz	place
+	STR	r5	r4	#1
+	ADD	r4	r4	#-1
+	BRnzp	inner
+place:	STR	r3	r4	#1
+	ADD	r1	r1	#1
+	LD	r2	left
+	ADD	r2	r2	#-1
+	ST	r2	left
+	BRp	outer
+	ADD	r6	r6	#-1
+	BRp	round
+	HALT
+rounds:	.FILL	#20
+count:	.FILL	#256
+seed:	.FILL	#1
+mask:	.FILL	$7FFF
+left:	.FILL	#0
+sentinel:	.FILL	#0
+array:	.BLKW	#256
+	.END
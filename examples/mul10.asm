@@ -1,7 +1,7 @@
 ;; set r0 to 10*r1
 	.ORIG $3000
-mul10:	ADD	%0	%1	%1
-	ADD	%0	%0	%0
-	ADD	%0	%0	%1
-	ADD	%0	%0	%0
+mul10:	ADD	r0	r1	r1
+	ADD	r0	r0	r0
+	ADD	r0	r0	r1
+	ADD	r0	r0	r0
 	HALT
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "list_pool.h"
+
+namespace lc3 {
+
+using u16 = std::uint16_t;
+
+// An error found in the source, with the line it was found on.
+struct diagnostic_t {
+    int line_number;
+    std::string message;
+};
+
+// The single-pass assembler behind lc3al, working entirely in memory: it
+// reads no files, writes none and never ends the process. Assemblers share
+// no state, so any number of them can be used side by side, each from a
+// single thread at a time.
+class assembler {
+public:
+    // What the last call to assemble produced. The object is the origin
+    // followed by the words to place there, which lc3al writes out
+    // big-endian; the listing is the text lc3al writes next to it.
+    std::vector<u16> object;
+    std::string listing;
+    std::vector<diagnostic_t> diagnostics;
+
+    // Set when the source has more than one .ORIG. The object then holds a
+    // segmented object file instead, as lc3::machine::load_segmented reads
+    // it: "LC3S", the first origin as the entry, and each segment's origin,
+    // word count and words.
+    bool segmented = false;
+
+    // Set when assembly stopped at an error it could not get past, the last
+    // one in diagnostics. The object and listing are then incomplete.
+    bool stopped = false;
+
+    // Assembles the source in [f, l) from scratch, and returns whether it
+    // assembled without errors. The source does not have to end in a
+    // newline.
+    bool assemble(const char* f, const char* l);
+    bool assemble(const std::string& source) { return assemble(source.data(), source.data() + source.size()); }
+
+private:
+    enum token_kind {
+        TOKEN_NONE,
+        TOKEN_COLON,
+        TOKEN_COMMA,
+        TOKEN_NAME,
+        TOKEN_INTEGER,
+        TOKEN_STRING,
+        TOKEN_EOL,
+    };
+
+    struct token_t {
+        token_kind kind;
+        const char* f;
+        const char* l;
+        int base;
+    };
+
+    // A label, named by a span of symbol_names.
+    struct symbol_t {
+        std::uint32_t name;
+        std::uint32_t size;
+        int line_number;
+        u16 location;
+    };
+
+    struct opcode_t {
+        const char* name;
+        u16 base_code;
+        void (assembler::*assemble)(const opcode_t*);
+    };
+
+    // Thrown by fatal_error and caught by assemble.
+    struct stop_t { };
+
+    static const opcode_t opcodes[];
+
+    // The place in object of each forward reference to an undefined symbol,
+    // threaded through its location.
+    rks::list_pool<std::uint32_t, u16> pool;
+    // The names of all symbols, end to end.
+    std::string symbol_names;
+    // The symbols in the order they first appear, which is the order of the
+    // symbol table in the listing.
+    std::vector<symbol_t> symbols;
+    // An open-addressing hash table of 1 + the index in symbols, or 0 for an
+    // empty slot. Its size is a power of two and it is kept at most half
+    // full.
+    std::vector<std::uint32_t> symbol_slots;
+
+    // The line being assembled, up to and including its '\n'. Lines are
+    // read in place from the source.
+    const char* line = nullptr;
+    const char* line_cursor = nullptr;
+    int line_number = 0;
+    int listed_line_number = 0; // the last line shown in the listing
+    token_t token = {};
+    bool originated = false; // by .ORIG, or the attempt at it on the first line
+    bool ended = false;      // by .END
+    // Where each segment's origin is in object. While assembling, object is
+    // always laid out as a segmented object file; assemble turns it into a
+    // plain one at the end when there is a single segment.
+    std::vector<std::size_t> segments;
+
+    void report(const char* format, va_list args);
+    void error(const char* format, ...);
+    [[noreturn]] void fatal_error(const char* format, ...);
+
+    void next_token();
+    bool peek(token_kind x) const { return token.kind == x; }
+    bool match(token_kind x);
+    token_t expect();
+    token_t expect(token_kind x);
+    bool peek_register() const;
+    u16 expect_register();
+
+    u16 location_counter() const
+    {
+        return object[segments.back()] + static_cast<u16>(object.size() - segments.back() - 2);
+    }
+    const char* symbol_name(const symbol_t& symbol) const { return symbol_names.data() + symbol.name; }
+    void grow_symbol_slots();
+    symbol_t& get_symbol(const char* f, const char* l);
+    static const opcode_t* get_opcode(const char* f, const char* l);
+
+    void print_listing(u16 x);
+    void write_instruction(u16 x);
+    void assemble_add_and(const opcode_t* op);
+    void assemble_label(symbol_t& symbol, u16 base_code, int n);
+    void assemble_branch(const opcode_t* op);
+    void assemble_jump(const opcode_t* op);
+    void assemble_jump_subroutine(const opcode_t* op);
+    void assemble_load_store(const opcode_t* op);
+    void assemble_load_store_relative(const opcode_t* op);
+    void assemble_not(const opcode_t* op);
+    void assemble_trap(const opcode_t* op);
+    void assemble_base_code(const opcode_t* op);
+    void directive_orig(const opcode_t* op);
+    void directive_end(const opcode_t* op);
+    void directive_blkw(const opcode_t* op);
+    void directive_fill(const opcode_t* op);
+    void directive_stringz(const opcode_t* op);
+    void fix_forward_references(std::uint32_t place);
+    void finish_object();
+    void assemble_line();
+    void assemble_lines(const char* f, const char* l);
+};
+
+} // namespace lc3
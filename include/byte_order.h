@@ -1,6 +1,7 @@
 #pragma once
 
 #include <climits>
+#include <cstddef>
 
 namespace rks {
 
@@ -46,4 +47,19 @@ I load_big_endian(T& x, I f_i)
     return f_i;
 }
 
+// Reads n big-endian Ts from f_i. Kept to plain byte arithmetic on pointers
+// so the compiler can turn the loop into a vectorised byte swap.
+template <typename T>
+// requires UnsignedInteger(T)
+T* load_big_endian_n(const unsigned char* f_i, std::size_t n, T* f_o)
+{
+    for (std::size_t i(0); i < n; ++i) {
+        T x = T(0);
+        for (std::size_t j(0); j < sizeof(T); ++j)
+            x = T(x | (T(f_i[i * sizeof(T) + j]) << (sizeof(T) * CHAR_BIT - ((j + 1) * CHAR_BIT))));
+        f_o[i] = x;
+    }
+    return f_o + n;
+}
+
 } // namespace rks
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace lc3 {
+
+// Where the trap routines read and write characters.
+class console {
+public:
+    virtual ~console() = default;
+
+    // Returned by get when no input is available yet.
+    static const int empty = -2;
+
+    // Returns EOF when there is no more input.
+    virtual int get() = 0;
+
+    // Like get, but returns empty rather than wait for input. Consoles that
+    // cannot tell just wait.
+    virtual int try_get() { return get(); }
+
+    virtual void put(int c) = 0;
+
+    // Used by PUTS and PUTSP to hand over a whole string at once.
+    virtual void write(const char* s, std::size_t n)
+    {
+        while (n--) put(static_cast<unsigned char>(*s++));
+    }
+
+    virtual void flush() { }
+};
+
+// Reads stdin and collects output in a large buffer that goes to stdout when
+// it fills up, when the program asks for input and on flush. With a writer
+// thread, full buffers are written in the background while the program keeps
+// running; flush still waits until everything has reached stdout.
+class stdio_console : public console {
+public:
+    static const std::size_t capacity = std::size_t(1) << 16;
+
+    explicit stdio_console(bool writer_thread = false);
+    ~stdio_console() override;
+    stdio_console(const stdio_console&) = delete;
+    stdio_console& operator=(const stdio_console&) = delete;
+
+    int get() override;
+    int try_get() override;
+
+    void put(int c) override
+    {
+        buffer.push_back(static_cast<char>(c));
+        if (buffer.size() >= capacity) drain();
+    }
+
+    void write(const char* s, std::size_t n) override;
+    void flush() override;
+
+private:
+    char input[4096];
+    std::size_t input_first = 0;
+    std::size_t input_last = 0;
+    std::string buffer;
+    std::string pending; // owned by the writer thread while busy
+    bool busy = false;
+    bool stopping = false;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+
+    bool fill_input();
+    void drain();
+    void write_pending();
+};
+
+// Feeds GETC and IN from a script and captures everything written, for batch
+// runs and tests.
+class string_console : public console {
+public:
+    std::string input;
+    std::size_t position = 0;
+    int end = EOF; // what get returns once the script is used up
+    std::string output;
+
+    string_console() = default;
+    explicit string_console(std::string script) : input(std::move(script)) { }
+
+    int get() override
+    {
+        if (position == input.size()) return end;
+        return static_cast<unsigned char>(input[position++]);
+    }
+
+    void put(int c) override { output.push_back(static_cast<char>(c)); }
+    void write(const char* s, std::size_t n) override { output.append(s, n); }
+};
+
+// The process' stdin and stdout, without a writer thread.
+console& standard_console();
+
+} // namespace lc3
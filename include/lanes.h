@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include "machine.h"
+
+namespace lc3 {
+
+// Runs count machines that hold the same program, such as machines forked
+// from one snapshot with different input, side by side. Each instruction is
+// fetched once for all the machines that have reached it and carried out on
+// their registers together, with the registers of up to lane_width machines
+// laid out lane by lane so that the compiler can use vector instructions.
+// Machines whose paths part are regrouped by program counter, lowest first,
+// so that they tend to meet again after an if or a loop.
+//
+// TRAPs, RTI, exceptions and device registers run one machine at a time on
+// step; a machine that enables the keyboard interrupt leaves the group and
+// finishes on its own engine. Every machine is held to limits by itself,
+// except for the time limit, which all of them share. Sets statuses[i] to
+// what machines[i] stopped with.
+void run_lanes(machine* const* machines, std::size_t count, const limits_t& limits,
+               status_kind* statuses);
+
+// The most machines run_lanes runs as one group; more are run a group at a
+// time.
+const std::size_t lane_width = 64;
+
+} // namespace lc3
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include "machine.h"
+
+namespace lc3 {
+
+struct divergence_t {
+    bool found = false;
+    // The machines agreed after instruction first and disagreed after last.
+    u64 first = 0;
+    u64 last = 0;
+    // One line per difference: registers, condition codes, the processor
+    // status, device registers, the first word of memory and output.
+    std::string differences;
+};
+
+// Runs candidate side by side with reference, which should be a machine on
+// ENGINE_STEP forked from the same snapshot, and stops them both at the
+// first point where their state tells them apart. They are compared after
+// every interval instructions; the fast engines only get to run whole
+// blocks and superinstructions when interval leaves room for them.
+//
+// Both machines read the input of reference's console, candidate each
+// character no earlier than reference got it, and only reference's output
+// goes to its console; candidate's has to match it. The limits apply to
+// reference. Returns the status both machines stopped with, or reference's
+// when they diverged.
+status_kind run_lockstep(machine& reference, machine& candidate, const limits_t& limits,
+                         u64 interval, divergence_t& divergence);
+
+} // namespace lc3
@@ -0,0 +1,369 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include "console.h"
+
+namespace lc3 {
+
+using u16 = std::uint16_t;
+using u64 = std::uint64_t;
+
+enum {
+    OP_BR,
+    OP_ADD,
+    OP_LD,
+    OP_ST,
+    OP_JSR,
+    OP_AND,
+    OP_LDR,
+    OP_STR,
+    OP_RTI,
+    OP_NOT,
+    OP_LDI,
+    OP_STI,
+    OP_JMP,
+    OP_INVALID,
+    OP_LEA,
+    OP_TRAP,
+};
+
+enum {
+    TRAP_GETC = 0x20,
+    TRAP_OUT  = 0x21,
+    TRAP_PUTS = 0x22,
+    TRAP_IN   = 0x23,
+    TRAP_PUTSP = 0x24,
+    TRAP_HALT = 0x25,
+};
+
+enum {
+    FLAG_POSITIVE = 1 << 0,
+    FLAG_ZERO = 1 << 1,
+    FLAG_NEGATIVE = 1 << 2,
+};
+
+// Memory-mapped device registers.
+enum {
+    DEVICE_BASE = 0xFE00,
+    DEVICE_KBSR = 0xFE00, // keyboard status
+    DEVICE_KBDR = 0xFE02, // keyboard data
+    DEVICE_DSR  = 0xFE04, // display status
+    DEVICE_DDR  = 0xFE06, // display data
+    DEVICE_PSR  = 0xFFFC, // processor status
+    DEVICE_MCR  = 0xFFFE, // machine control
+};
+
+enum {
+    DEVICE_READY = 1 << 15,
+    DEVICE_INTERRUPT_ENABLE = 1 << 14,
+    MCR_CLOCK_ENABLE = 1 << 15,
+    PSR_USER = 1 << 15,
+    PSR_PRIORITY = 0x7 << 8,
+};
+
+// Interrupt and exception vectors; the handler addresses are at
+// INTERRUPT_TABLE + vector.
+enum {
+    INTERRUPT_TABLE = 0x0100,
+    VECTOR_PRIVILEGE = 0x00,
+    VECTOR_ILLEGAL_OPCODE = 0x01,
+    VECTOR_KEYBOARD = 0x80,
+};
+
+enum engine_kind {
+    ENGINE_INTERP,
+    ENGINE_JIT,
+    ENGINE_STEP, // step for every instruction: slow, but the reference
+    ENGINE_AOT,  // the code lc3aot translated the program into; see translation
+};
+
+// Where TRAP finds its service routines.
+enum os_kind {
+    OS_NONE,        // the simulator's own, for the standard vectors only
+    OS_GUEST,       // the trap vector table at 0x0000 and code in memory
+    OS_ACCELERATED, // as OS_GUEST, running the routines of os/lc3os.asm natively
+};
+
+enum status_kind {
+    STATUS_RUNNING, // the instruction budget ran out
+    STATUS_HALTED,
+    STATUS_INVALID, // an exception with no handler installed
+    STATUS_WAITING, // GETC or IN found no input; the TRAP will be retried
+    STATUS_END_OF_INPUT, // GETC or IN found the end of input; not executed
+    STATUS_INSTRUCTION_LIMIT,
+    STATUS_TIME_LIMIT,
+    STATUS_OUTPUT_LIMIT, // the TRAP printed up to the limit and was executed
+};
+
+// Bounds on a single machine::run(const limits_t&); the defaults impose none.
+struct limits_t {
+    u64 instructions = std::numeric_limits<u64>::max();
+    double seconds = std::numeric_limits<double>::infinity();
+    u64 output = std::numeric_limits<u64>::max(); // bytes
+};
+
+inline
+u16 sign_extend(u16 x, int n)
+{
+    if ((x >> (n - 1)) & 1) x |= (0xFFFF << n);
+    return x;
+}
+
+inline
+u16 sign_extend_mask(u16 x, int n)
+{
+    u16 mask = 0xFFFF >> (16 - n);
+    return sign_extend(x & mask, n);
+}
+
+struct decoded_t;
+class jit;
+class memory_profile;
+class profile;
+class snapshot;
+class trace_writer;
+struct translation_t;
+
+// One LC-3: registers, condition codes and the full 64K-word address space.
+// Machines share no state, so any number of them can be run side by side,
+// each from a single thread at a time.
+//
+// Memory is split into pages that can be shared with snapshots and the
+// machines restored from them. A machine copies a shared page the first time
+// it writes to it, so taking a snapshot or forking from one costs nothing up
+// front. Memory nobody has written to yet is a single page of zeros shared by
+// every machine, so a new machine owns no pages at all, and one forked from a
+// loaded program only owns the pages it writes.
+//
+// Loads and stores at DEVICE_BASE and up reach the device registers. The
+// keyboard reads from io, blocking only once the program is seen polling
+// KBSR; the display is always ready. With interrupts enabled in KBSR, run
+// delivers the keyboard interrupt through the table at INTERRUPT_TABLE, and
+// waits for input instead of spinning when the program idles in a BR to
+// itself. TRAPs are carried out natively unless os says otherwise.
+class machine {
+public:
+    static const std::size_t memory_size = std::size_t(1) << 16;
+    static const int page_bits = 12;
+    static const std::size_t page_size = std::size_t(1) << page_bits;
+    static const std::size_t page_count = memory_size / page_size;
+
+    struct page_t {
+        u16 words[page_size];
+    };
+
+    u16 registers[8] = {};
+    u16 program_counter = 0;
+    u16 condition_register = FLAG_ZERO;
+
+    // The rest of the processor status register: PSR_USER and the priority.
+    u16 processor_status = PSR_USER;
+    u16 saved_ssp = 0x3000; // R6 for supervisor mode while in user mode
+    u16 saved_usp = 0;      // R6 for user mode while in supervisor mode
+
+    // Device registers that are not plain memory.
+    u16 keyboard_status = 0; // DEVICE_INTERRUPT_ENABLE and DEVICE_READY
+    u16 keyboard_data = 0;
+    u16 display_status = DEVICE_READY; // the display is always ready
+
+    engine_kind engine = ENGINE_INTERP;
+
+    // With OS_GUEST or OS_ACCELERATED, TRAP saves the return address in R7
+    // and jumps through the trap vector table, so an operating system such
+    // as os/lc3os.asm has to be loaded with the program. OS_ACCELERATED
+    // checks that a routine is still the one os/lc3os.asm has for its
+    // vector, and if so does what it would without running it; the registers,
+    // memory and devices end up the same, only in fewer instructions.
+    os_kind os = OS_NONE;
+
+    // Lets ENGINE_INTERP run an instruction and the BR after it as one
+    // superinstruction. Turning it off gives the same results, only slower.
+    bool fusion = true;
+
+    // When set, run counts what it executes here instead of using the
+    // selected engine.
+    profile* profiler = nullptr;
+
+    // When set, run counts the memory it reads and writes here instead of
+    // using the selected engine.
+    memory_profile* memory_profiler = nullptr;
+
+    // When set, run records every instruction it executes here, also on
+    // ENGINE_INTERP.
+    trace_writer* tracer = nullptr;
+    console* io = &standard_console();
+
+    // For ENGINE_AOT: the program in memory, translated ahead of time. Code
+    // it does not cover runs on step. Writing over any of its code sets it
+    // back to nullptr, and the interpreter takes over from there.
+    const translation_t* translation = nullptr;
+
+    // The number of instructions retired so far.
+    u64 instructions = 0;
+
+    machine();
+    explicit machine(const snapshot& x);
+    ~machine();
+    machine(const machine&) = delete;
+    machine& operator=(const machine&) = delete;
+
+    // Loads an object file and points the program counter at its entry. A
+    // plain object file, as written by lc3al, is the origin followed by the
+    // words to place there, all big-endian. A file named *.lc3s is loaded as
+    // a segmented object file instead. Returns false and leaves errno set on
+    // failure; ENOEXEC means the file is truncated or does not fit in
+    // memory, and nothing has been loaded.
+    bool load(const char* filename);
+
+    // Loads a plain object file held in memory, as load(filename) does.
+    bool load(const unsigned char* f, std::size_t n);
+
+    // Loads a segmented object file held in memory: the bytes "LC3S" and the
+    // entry address, followed by any number of segments, each an origin, a
+    // word count and that many words, all big-endian.
+    bool load_segmented(const unsigned char* f, std::size_t n);
+
+    // Whether load takes filename for a segmented object file.
+    static bool segmented(const char* filename)
+    {
+        std::size_t n = std::strlen(filename);
+        return n >= 5 && std::strcmp(filename + n - 5, ".lc3s") == 0;
+    }
+
+    // Copies [f, l) to memory at origin and points the program counter there.
+    void load(u16 origin, const u16* f, const u16* l);
+
+    u16 read(u16 address) const
+    {
+        return readable[address >> page_bits][address & (page_size - 1)];
+    }
+
+    void write(u16 address, u16 value);
+
+    // Executes exactly one instruction with the reference interpreter.
+    status_kind step();
+
+    // Executes up to n instructions with the selected engine.
+    status_kind run(u64 n);
+
+    // Runs until the program stops or one of the limits is reached. The
+    // instruction budget is charged a block at a time by the JIT and the
+    // clock is looked at every million or so instructions, so the limits
+    // cost next to nothing.
+    status_kind run(const limits_t& limits);
+
+    // Captures registers and memory; from here on both the machine and the
+    // snapshot share every page.
+    snapshot save();
+
+    // Puts the machine back into the state captured by x.
+    void restore(const snapshot& x);
+
+    // The pages of memory held apart from the shared page of zeros, and how
+    // many of those this machine holds alone.
+    std::size_t resident_pages() const;
+    std::size_t private_pages() const;
+
+    // Returns true when memory holds the same as other's. Otherwise sets
+    // address to the first word that differs. Pages the two machines still
+    // share are not looked at, so this is cheap for machines forked from the
+    // same snapshot.
+    bool same_memory(const machine& other, u16& address) const;
+
+private:
+    friend class jit;
+    friend class lanes;
+
+    std::shared_ptr<page_t> pages[page_count];
+    const u16* readable[page_count];
+    u16* writable[page_count]; // nullptr while the page is shared
+    // run_interp's pre-decoded records, paged like memory. Pages with
+    // nothing decoded yet point at a shared page of X_DECODE records.
+    std::unique_ptr<decoded_t[]> decoded_pages[page_count];
+    const decoded_t* decoded[page_count];
+    std::unique_ptr<jit> jit_engine;
+    u64 output_left = std::numeric_limits<u64>::max();
+
+    void store(u16 address, u16 value)
+    {
+        u16* page = writable[address >> page_bits];
+        if (!page) page = make_writable(address >> page_bits);
+        page[address & (page_size - 1)] = value;
+    }
+
+    u16* make_writable(std::size_t page);
+    decoded_t* make_decoded(std::size_t page);
+    void invalidate_decoded(u16 address);
+    void reset_decoded();
+    void load_big_endian(u16 origin, const unsigned char* f, std::size_t n);
+    void set_condition_codes(u16 x);
+    // Set by the device registers when the instruction accessing them stops
+    // the machine.
+    status_kind device_status = STATUS_RUNNING;
+    u16 poll_address = 0;     // the last instruction to find KBSR not ready
+    u64 poll_instructions = 0; // and when it did
+    bool yield = false; // set when the engine should hand back to run
+    bool prompted = false; // by a TRAP IN still waiting for its character
+    // The instruction count when an instruction that had been reported to
+    // the observers stopped to wait for input. Until another instruction
+    // completes, the one at program_counter is it, run again, and is not
+    // reported a second time.
+    u64 waited_at = ~u64(0);
+
+    u16 load(u16 address)
+    {
+        return address >= DEVICE_BASE ? load_device(address) : read(address);
+    }
+
+    u16 load_device(u16 address);
+    void store_device(u16 address, u16 value);
+    status_kind poll_keyboard(bool block);
+    void set_processor_status(u16 psr);
+    template <typename Observer>
+    void enter_interrupt(u16 vector, u16 priority, Observer& observer);
+    void interrupt(u16 vector, u16 priority);
+    template <typename Observer>
+    status_kind exception(u16 vector, Observer& observer);
+    status_kind run_engine(u64 n);
+    bool output(const char* s, std::size_t n);
+    status_kind trap(u16 vector);
+    bool os_routine(u16 vector, u16 entry, u16& size) const;
+    status_kind os_trap(u16 vector, u16& saved, u16& saved_count);
+    void invalidate(u16 address);
+    void invalidate_all();
+    template <typename Observer>
+    status_kind step(Observer& observer);
+    template <typename Observer>
+    status_kind run_step(u64 n, Observer& observer);
+    template <typename Observer>
+    status_kind run_interp(u64 n, Observer& observer);
+    status_kind run_memory_profiled(u64 n);
+    status_kind run_jit(u64 n);
+    status_kind run_aot(u64 n);
+};
+
+class snapshot {
+public:
+    u16 registers[8];
+    u16 program_counter;
+    u16 condition_register;
+    u16 processor_status;
+    u16 saved_ssp;
+    u16 saved_usp;
+    u16 keyboard_status;
+    u16 keyboard_data;
+    u16 display_status;
+    u64 instructions;
+
+private:
+    friend class machine;
+
+    std::shared_ptr<machine::page_t> pages[machine::page_count];
+    bool prompted;
+};
+
+} // namespace lc3
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rks {
+
+// A whole file mapped read-only into memory. Empty files map to a null range.
+class mapped_file {
+public:
+    mapped_file() = default;
+    ~mapped_file() { close(); }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    // Returns false and leaves errno set on failure.
+    bool open(const char* filename)
+    {
+        close();
+#ifdef _WIN32
+        HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) return fail();
+        LARGE_INTEGER length;
+        if (!GetFileSizeEx(file, &length)) {
+            CloseHandle(file);
+            return fail();
+        }
+        size_ = static_cast<std::size_t>(length.QuadPart);
+        if (size_ != 0) {
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                data_ = static_cast<const unsigned char*>(
+                    MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+                CloseHandle(mapping);
+            }
+        }
+        CloseHandle(file);
+        if (size_ != 0 && !data_) return fail();
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if (fd == -1) return false;
+        struct stat status;
+        if (fstat(fd, &status) == -1) {
+            int saved = errno;
+            ::close(fd);
+            errno = saved;
+            return false;
+        }
+        size_ = static_cast<std::size_t>(status.st_size);
+        if (size_ != 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                int saved = errno;
+                ::close(fd);
+                size_ = 0;
+                errno = saved;
+                return false;
+            }
+            data_ = static_cast<const unsigned char*>(p);
+        }
+        ::close(fd);
+#endif
+        return true;
+    }
+
+    void close()
+    {
+        if (data_) {
+#ifdef _WIN32
+            UnmapViewOfFile(data_);
+#else
+            munmap(const_cast<unsigned char*>(data_), size_);
+#endif
+        }
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const unsigned char* begin() const { return data_; }
+    const unsigned char* end() const { return data_ + size_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const unsigned char* data_ = nullptr;
+    std::size_t size_ = 0;
+
+#ifdef _WIN32
+    bool fail()
+    {
+        DWORD error = GetLastError();
+        errno = error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND ? ENOENT
+              : error == ERROR_ACCESS_DENIED ? EACCES
+              : EIO;
+        size_ = 0;
+        return false;
+    }
+#endif
+};
+
+} // namespace rks
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include "machine.h"
+
+namespace lc3 {
+
+// Memory access counts gathered by a machine whose memory_profiler points
+// here: reads by LD, LDR, LDI, STI (its pointer) and the strings TRAP PUTS
+// and PUTSP print, writes by ST, STR and STI. It also samples the working
+// set, the memory touched in each window of instructions, in blocks of
+// block_size words and pages of machine::page_size words. While profiling,
+// the machine runs on ENGINE_INTERP whatever engine is selected.
+class memory_profile {
+public:
+    static const int block_bits = 6;
+    static const std::size_t block_size = std::size_t(1) << block_bits;
+    static const std::size_t block_count = machine::memory_size / block_size;
+
+    // The memory touched in one window, and in all windows until its end.
+    struct sample_t {
+        u64 end; // instructions run by the end of the window
+        std::size_t blocks;
+        std::size_t pages;
+        std::size_t total_blocks;
+    };
+
+    std::vector<u64> reads;  // per address
+    std::vector<u64> writes; // per address
+    std::vector<sample_t> samples;
+
+    // Reads the instructions and the registers of m as it runs them.
+    explicit memory_profile(const machine& m);
+
+    void execute(u16 address);
+    void branch(u16, bool) { }
+    void call(u16) { }
+    void write_register(u16, u16) { }
+
+    void write_memory(u16 address, u16)
+    {
+        ++writes[address];
+        touch(address);
+    }
+
+    // Writes a report: totals, the working set over time, a map of the
+    // accesses to each block of memory and the hottest blocks and
+    // addresses. Returns false and leaves errno set on failure.
+    bool write_report(const char* filename) const;
+
+private:
+    // Windows start at this many instructions; once there are max_samples,
+    // neighbouring samples are merged and windows get twice as long.
+    static const u64 first_window = 1 << 16;
+    static const std::size_t max_samples = 1024;
+
+    const machine& m;
+    u64 executed = 0;
+    u64 window = first_window;
+    u64 window_end = first_window;
+    // The window in which each block and page was last touched, counting
+    // from 1, and whether a block was ever touched.
+    u64 current = 1;
+    std::vector<u64> block_stamps;
+    std::vector<u64> page_stamps;
+    std::vector<bool> seen;
+    sample_t next = {};
+
+    void read(u16 address)
+    {
+        ++reads[address];
+        touch(address);
+    }
+
+    void touch(u16 address)
+    {
+        std::size_t block = address >> block_bits;
+        if (block_stamps[block] == current) return;
+        block_stamps[block] = current;
+        ++next.blocks;
+        if (!seen[block]) {
+            seen[block] = true;
+            ++next.total_blocks;
+        }
+        std::size_t page = address >> machine::page_bits;
+        if (page_stamps[page] != current) {
+            page_stamps[page] = current;
+            ++next.pages;
+        }
+    }
+
+    void end_window();
+};
+
+} // namespace lc3
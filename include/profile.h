@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+#include "machine.h"
+
+namespace lc3 {
+
+// Execution counts gathered by a machine whose profiler points here. While
+// profiling, the machine runs on ENGINE_INTERP whatever engine is selected.
+class profile {
+public:
+    std::vector<u64> executed;  // per address
+    std::vector<u64> taken;     // per BR address
+    std::vector<u64> not_taken; // per BR address
+    std::vector<u64> calls;     // per JSR/JSRR target
+
+    profile() :
+        executed(machine::memory_size),
+        taken(machine::memory_size),
+        not_taken(machine::memory_size),
+        calls(machine::memory_size)
+    { }
+
+    void execute(u16 address) { ++executed[address]; }
+
+    void branch(u16 address, bool is_taken)
+    {
+        ++(is_taken ? taken : not_taken)[address];
+    }
+
+    void call(u16 target) { ++calls[target]; }
+    void write_register(u16, u16) { }
+    void write_memory(u16, u16) { }
+
+    // Writes a report on the program in m: an opcode histogram, the hottest
+    // addresses, every branch and call target, and the listing written by
+    // lc3al with the execution count of each line. listing_filename may be
+    // null or name a file that does not exist, in which case the report
+    // goes without source. Returns false and leaves errno set on failure.
+    bool write_report(const char* filename, const machine& m,
+                      const char* listing_filename) const;
+};
+
+} // namespace lc3
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include "console.h"
+#include "machine.h"
+
+#if defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <unordered_map>
+#endif
+
+namespace lc3 {
+
+// A machine that its host runs a slice at a time and feeds input as it
+// arrives, so that one thread can take turns between many of them. When
+// the program asks for input that has not arrived yet, resume returns
+// STATUS_WAITING with nothing lost, and the next resume after feed carries
+// on with the same instruction.
+class session {
+public:
+    // The program; its console belongs to the session.
+    machine guest;
+
+    session();
+    // Starts from x, such as a snapshot taken once the program has started,
+    // sharing its memory with every other session started from it.
+    explicit session(const snapshot& x);
+    session(const session&) = delete;
+    session& operator=(const session&) = delete;
+
+    // Hands the program more input.
+    void feed(const char* s, std::size_t n);
+    void feed(const std::string& s) { feed(s.data(), s.size()); }
+
+    // No more input will come: reading past what was fed ends the program
+    // with STATUS_END_OF_INPUT.
+    void close();
+
+    // Everything the program has written since the last call.
+    std::string take_output();
+
+    // Runs up to n instructions, or until the program needs input it has
+    // not been fed or stops. Returns STATUS_RUNNING when n ran out and
+    // STATUS_WAITING when it needs input; it can be resumed after either.
+    // Once it has stopped for good, returns the same status again.
+    status_kind resume(u64 n);
+
+    status_kind status() const { return last; }
+
+    // Whether resume would just return status again.
+    bool finished() const { return last != STATUS_RUNNING && last != STATUS_WAITING; }
+
+private:
+    string_console io;
+    status_kind last = STATUS_RUNNING;
+};
+
+#if defined(__cpp_impl_coroutine)
+
+// A coroutine that starts right away and cleans up after itself, for hosts
+// that serve each session from one: co_await scheduler::run(s) in it.
+// Exceptions that leave it terminate the program.
+class session_task {
+public:
+    struct promise_type {
+        session_task get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+// Takes turns between sessions on one thread: each runs for a slice of
+// instructions at a time, and a session waiting for input is set aside until
+// it is fed through the scheduler. A thread pool runs a scheduler per
+// thread; neither the scheduler nor its sessions may be touched from other
+// threads.
+class scheduler {
+public:
+    explicit scheduler(u64 slice = 100000) : slice(slice) { }
+    scheduler(const scheduler&) = delete;
+    scheduler& operator=(const scheduler&) = delete;
+
+    // Awaiting run(s) suspends the coroutine until s stops for good, and
+    // gives the status it stopped with.
+    auto run(session& s)
+    {
+        struct awaiter {
+            scheduler& owner;
+            session& s;
+
+            bool await_ready() const { return s.finished(); }
+
+            void await_suspend(std::coroutine_handle<> waiter)
+            {
+                owner.ready.push_back(entry_t{&s, waiter});
+            }
+
+            status_kind await_resume() const { return s.status(); }
+        };
+        return awaiter{*this, s};
+    }
+
+    // Feeds s, and gives it turns again if it was waiting for input.
+    void feed(session& s, const char* text, std::size_t n)
+    {
+        s.feed(text, n);
+        wake(s);
+    }
+
+    void feed(session& s, const std::string& text) { feed(s, text.data(), text.size()); }
+
+    void close(session& s)
+    {
+        s.close();
+        wake(s);
+    }
+
+    // Gives sessions turns until every one has stopped or waits for input.
+    // Coroutines awaiting a session that stopped are resumed from here.
+    void run_until_idle()
+    {
+        while (!ready.empty()) {
+            entry_t e = ready.front();
+            ready.pop_front();
+            status_kind status = e.s->resume(slice);
+            if (status == STATUS_RUNNING) ready.push_back(e);
+            else if (status == STATUS_WAITING) waiting.emplace(e.s, e);
+            else e.waiter.resume();
+        }
+    }
+
+    // Sessions that are set aside until they are fed.
+    std::size_t waiting_count() const { return waiting.size(); }
+
+private:
+    struct entry_t {
+        session* s;
+        std::coroutine_handle<> waiter;
+    };
+
+    u64 slice;
+    std::deque<entry_t> ready;
+    std::unordered_map<session*, entry_t> waiting;
+
+    void wake(session& s)
+    {
+        auto i = waiting.find(&s);
+        if (i == waiting.end()) return;
+        ready.push_back(i->second);
+        waiting.erase(i);
+    }
+};
+
+#endif
+
+} // namespace lc3
@@ -0,0 +1,278 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "machine.h"
+#include "mapped_file.h"
+
+namespace lc3 {
+
+// A trace file is the bytes "LC3T" and a version, followed by one record per
+// instruction executed and one per character of input:
+//
+//   instruction  a tag byte below 0x80: TRACE_TAG_JUMP when the address is not
+//                the one after the previous instruction, followed by the
+//                difference; TRACE_TAG_REGISTER with the register number in
+//                bits 2-4, followed by the difference from the register's
+//                last recorded value; TRACE_TAG_MEMORY, followed by the
+//                difference from the last address written and the value;
+//                TRACE_TAG_MORE when the instruction wrote more than one
+//                register or word, followed by the number of further writes
+//                and each of them: a register number and the difference, or
+//                8 and the address difference and value of a word.
+//   input        TRACE_TAG_INPUT, the machine's instruction count when the
+//                character arrived and the character plus one, 0 for EOF.
+//
+// Differences are zigzag-encoded and every number is a LEB128 varint, so a
+// typical instruction takes two or three bytes.
+enum {
+    TRACE_TAG_JUMP = 0x01,
+    TRACE_TAG_REGISTER = 0x02,
+    TRACE_TAG_MEMORY = 0x20,
+    TRACE_TAG_MORE = 0x40,
+    TRACE_TAG_INPUT = 0x80,
+};
+
+struct trace_write_t {
+    int r; // the register written, or -1 for a word of memory
+    u16 address; // of the word
+    u16 value;
+};
+
+// Records a run to a file: open it, then point machine::tracer here. Records
+// are collected in a ring of large chunks that a background thread writes
+// out, so the machine only waits when the disk falls behind.
+class trace_writer {
+public:
+    trace_writer();
+    ~trace_writer();
+    trace_writer(const trace_writer&) = delete;
+    trace_writer& operator=(const trace_writer&) = delete;
+
+    // Returns false and leaves errno set on failure.
+    bool open(const char* filename);
+
+    // Writes out everything recorded so far and closes the file. Returns
+    // false and leaves errno set when any of it could not be written.
+    bool close();
+
+    void execute(u16 address)
+    {
+        if (started) finish_record();
+        started = true;
+        tag = 0;
+        more.clear();
+        address_ = address;
+    }
+
+    void branch(u16, bool) { }
+    void call(u16) { }
+
+    void write_register(u16 r, u16 value)
+    {
+        if (tag & TRACE_TAG_REGISTER) {
+            more.push_back(trace_write_t{r, 0, value});
+            return;
+        }
+        tag = static_cast<unsigned char>(tag | TRACE_TAG_REGISTER | r << 2);
+        register_value = value;
+    }
+
+    void write_memory(u16 address, u16 value)
+    {
+        if (tag & TRACE_TAG_MEMORY) {
+            more.push_back(trace_write_t{-1, address, value});
+            return;
+        }
+        tag |= TRACE_TAG_MEMORY;
+        memory_address = address;
+        memory_value = value;
+    }
+
+    void input(u64 instruction, int c);
+
+private:
+    static const std::size_t chunk_size = std::size_t(1) << 20;
+    static const std::size_t chunk_count = 8;
+    // More than the longest record, or the longest write beyond its first.
+    static const std::size_t slack = 32;
+
+    FILE* file = nullptr;
+    std::unique_ptr<unsigned char[]> ring;
+    std::size_t filled[chunk_count];
+    std::size_t head = 0; // the chunk being filled
+    std::size_t tail = 0; // the oldest chunk not yet written
+    unsigned char* p = nullptr;
+    unsigned char* chunk_end = nullptr;
+    bool stopping = false;
+    int error = 0;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::thread writer;
+
+    // The instruction being recorded; its writes are still coming in.
+    bool started = false;
+    unsigned char tag = 0;
+    u16 address_ = 0;
+    u16 register_value = 0;
+    u16 memory_address = 0;
+    u16 memory_value = 0;
+    // Writes beyond the first register and the first word, which are rare.
+    std::vector<trace_write_t> more;
+
+    // What the records are relative to.
+    u16 next_address = 0;
+    u16 registers[8] = {};
+    u16 last_memory_address = 0;
+    u64 last_input = 0;
+
+    void put_unsigned(u64 x)
+    {
+        while (x >= 0x80) {
+            *p++ = static_cast<unsigned char>(x | 0x80);
+            x >>= 7;
+        }
+        *p++ = static_cast<unsigned char>(x);
+    }
+
+    void put_signed(u16 difference)
+    {
+        u16 x = static_cast<u16>(difference << 1 ^ -(difference >> 15));
+        put_unsigned(x);
+    }
+
+    void finish_record()
+    {
+        if (static_cast<std::size_t>(chunk_end - p) < slack) next_chunk();
+        unsigned char t = tag;
+        if (address_ != next_address) t |= TRACE_TAG_JUMP;
+        if (!more.empty()) t |= TRACE_TAG_MORE;
+        *p++ = t;
+        if (t & TRACE_TAG_JUMP) put_signed(static_cast<u16>(address_ - next_address));
+        if (t & TRACE_TAG_REGISTER) {
+            u16& last = registers[t >> 2 & 0x7];
+            put_signed(static_cast<u16>(register_value - last));
+            last = register_value;
+        }
+        if (t & TRACE_TAG_MEMORY) {
+            put_signed(static_cast<u16>(memory_address - last_memory_address));
+            put_unsigned(memory_value);
+            last_memory_address = memory_address;
+        }
+        if (t & TRACE_TAG_MORE) put_more();
+        next_address = static_cast<u16>(address_ + 1);
+    }
+
+    void put_more();
+    void next_chunk();
+    void write_chunks();
+};
+
+enum trace_record_kind {
+    TRACE_INSTRUCTION,
+    TRACE_INPUT,
+};
+
+struct trace_record_t {
+    trace_record_kind kind;
+    // For instructions their position in the trace; for input the machine's
+    // instruction count when it arrived.
+    u64 instruction;
+    u16 address;
+    // The first register and the first word the instruction wrote, then
+    // any others in the order it wrote them.
+    std::vector<trace_write_t> writes;
+    int c; // the character read, or EOF
+};
+
+// Reads back what a trace_writer wrote, a record at a time.
+class trace_reader {
+public:
+    // Returns false and leaves errno set on failure; EINVAL means the file is
+    // not a trace.
+    bool open(const char* filename);
+
+    // Returns false at the end of the trace, and also sets corrupt when the
+    // trace stops in the middle of a record.
+    bool next(trace_record_t& x);
+
+    bool corrupt = false;
+
+private:
+    rks::mapped_file file;
+    const unsigned char* p = nullptr;
+    const unsigned char* end = nullptr;
+    u64 count = 0;
+    u16 next_address = 0;
+    u16 registers[8] = {};
+    u16 last_memory_address = 0;
+    u64 last_input = 0;
+
+    bool get_unsigned(u64& x);
+    bool get_signed(u16& difference);
+    bool get_register(int r, trace_record_t& x);
+    bool get_memory(trace_record_t& x);
+};
+
+// Passes everything through to another console and records the input in a
+// trace, along with how far m had got when it arrived.
+class recording_console : public console {
+public:
+    recording_console(console& inner, trace_writer& trace, const machine& m) :
+        inner(inner), trace(trace), m(m)
+    { }
+
+    int get() override { return record(inner.get()); }
+    int try_get() override { return record(inner.try_get()); }
+    void put(int c) override { inner.put(c); }
+    void write(const char* s, std::size_t n) override { inner.write(s, n); }
+    void flush() override { inner.flush(); }
+
+private:
+    console& inner;
+    trace_writer& trace;
+    const machine& m;
+    bool at_end = false;
+
+    // A program that keeps polling at the end of input would otherwise fill
+    // the trace with EOFs.
+    int record(int c)
+    {
+        if (c == empty || (c == EOF && at_end)) return c;
+        at_end = c == EOF;
+        trace.input(m.instructions, c);
+        return c;
+    }
+};
+
+// Feeds m the input recorded in a trace, each character no earlier than it
+// arrived in the recorded run, and passes output through to another console.
+// Once the recorded input is used up, reads return EOF.
+class replay_console : public console {
+public:
+    replay_console(trace_reader& trace, console& output, const machine& m) :
+        trace(trace), output(output), m(m)
+    { }
+
+    int get() override;
+    int try_get() override;
+    void put(int c) override { output.put(c); }
+    void write(const char* s, std::size_t n) override { output.write(s, n); }
+    void flush() override { output.flush(); }
+
+private:
+    trace_reader& trace;
+    console& output;
+    const machine& m;
+    trace_record_t next_input;
+    bool have_input = false;
+
+    bool peek();
+};
+
+} // namespace lc3
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include "machine.h"
+
+namespace lc3 {
+
+// A program that lc3aot has translated into C++, for ENGINE_AOT. Every
+// instruction lc3aot could reach from the entry point is compiled in, except
+// for TRAPs, RTI, the invalid opcode and loads and stores at fixed device
+// registers, which are left to step. Jumps through a register go through a
+// switch on the target.
+struct translation_t {
+    // The object file translated, and whether it is segmented.
+    const unsigned char* object;
+    std::size_t object_size;
+    bool segmented;
+
+    // One bit for each word from code_begin on, set for the words compiled
+    // in.
+    u16 code_begin;
+    std::size_t code_size;
+    const unsigned char* code;
+
+    // Runs m from its program counter for up to n instructions and returns
+    // how many it ran. Stops early with the program counter on an
+    // instruction it leaves to step, or on one that was not compiled in, and
+    // right after a store over code clears m.translation.
+    u64 (*run)(machine& m, u64 n);
+
+    bool covers(u16 address) const
+    {
+        std::size_t i = static_cast<u16>(address - code_begin);
+        return i < code_size && (code[i >> 3] >> (i & 7) & 1);
+    }
+};
+
+// Defined in the code generated by lc3aot, and run by the main function in
+// the lc3aotmain library.
+extern const translation_t translated_program;
+
+} // namespace lc3
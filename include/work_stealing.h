@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rks {
+
+// Calls f(i) for every i in [0, n) on up to `threads` threads, the calling
+// thread included. Each thread starts with a contiguous share of the indices
+// and works through it from the front; once its own deque is empty it steals
+// from the back of the others'. No work is added while running, so a thread
+// that finds every deque empty is done.
+template <typename F>
+// requires Procedure(F) && Arity(F) == 1 && InputType(F, 0) == size_t
+void parallel_for_stealing(std::size_t n, unsigned threads, F f)
+{
+    struct queue_t {
+        std::mutex mutex;
+        std::deque<std::size_t> items;
+    };
+
+    if (threads == 0) threads = 1;
+    if (threads > n) threads = static_cast<unsigned>(n);
+    if (threads <= 1) {
+        for (std::size_t i(0); i < n; ++i) f(i);
+        return;
+    }
+
+    std::vector<queue_t> queues(threads);
+    for (unsigned t(0); t < threads; ++t) {
+        std::size_t f_i = n * t / threads;
+        std::size_t l_i = n * (t + 1) / threads;
+        for (; f_i != l_i; ++f_i) queues[t].items.push_back(f_i);
+    }
+
+    auto take = [&queues, threads](unsigned self, std::size_t& i) {
+        {
+            queue_t& own = queues[self];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.items.empty()) {
+                i = own.items.front();
+                own.items.pop_front();
+                return true;
+            }
+        }
+        for (unsigned k(1); k < threads; ++k) {
+            queue_t& victim = queues[(self + k) % threads];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.items.empty()) {
+                i = victim.items.back();
+                victim.items.pop_back();
+                return true;
+            }
+        }
+        return false;
+    };
+
+    auto worker = [&take, &f](unsigned self) {
+        std::size_t i;
+        while (take(self, i)) f(i);
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned t(1); t < threads; ++t) workers.emplace_back(worker, t);
+    worker(0);
+    for (std::thread& t : workers) t.join();
+}
+
+} // namespace rks
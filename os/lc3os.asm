@@ -0,0 +1,171 @@
+;; A minimal operating system: the trap vector table and the routines behind
+;; GETC, OUT, PUTS, IN, PUTSP and HALT, talking to the device registers.
+;; Load it before the program with lc3 --os. lc3al has no .FILL of a
+;; label, so the table holds the addresses of the routines as numbers. Each
+;; routine keeps its constants right after its code and the registers it
+;; saves after those;
+;; src/os.cpp carries out the routines natively as long as their code and
+;; constants read as they do here.
+	.ORIG $0000
+	.BLKW	#32
+	.FILL	$0200 ; os_getc
+	.FILL	$0206 ; os_out
+	.FILL	$020F ; os_puts
+	.FILL	$0222 ; os_in
+	.FILL	$0256 ; os_putsp
+	.FILL	$0281 ; os_halt
+	.BLKW	#474
+
+;; r0 = the next key
+os_getc:	LDI	r0	getc_kbsr
+	BRzp	os_getc
+	LDI	r0	getc_kbdr
+	RET
+getc_kbsr:	.FILL	$FE00
+getc_kbdr:	.FILL	$FE02
+
+;; writes the character in r0
+os_out:	ST	r1	out_r1
+out_wait:	LDI	r1	out_dsr
+	BRzp	out_wait
+	STI	r0	out_ddr
+	LD	r1	out_r1
+	RET
+out_dsr:	.FILL	$FE04
+out_ddr:	.FILL	$FE06
+out_r1:	.BLKW	#1
+
+;; writes the string of one character per word at r0
+os_puts:	ST	r0	puts_r0
+	ST	r1	puts_r1
+	ST	r2	puts_r2
+puts_next:	LDR	r1	r0	#0
+	BRz	puts_done
+puts_wait:	LDI	r2	puts_dsr
+	BRzp	puts_wait
+	STI	r1	puts_ddr
+	ADD	r0	r0	#1
+	BRnzp	puts_next
+puts_done:	LD	r0	puts_r0
+	LD	r1	puts_r1
+	LD	r2	puts_r2
+	RET
+puts_dsr:	.FILL	$FE04
+puts_ddr:	.FILL	$FE06
+puts_r0:	.BLKW	#1
+puts_r1:	.BLKW	#1
+puts_r2:	.BLKW	#1
+
+;; prompts for a key, echoes it and leaves it in r0
+os_in:	ST	r1	in_r1
+	ST	r2	in_r2
+	LEA	r1	in_prompt
+in_next:	LDR	r0	r1	#0
+	BRz	in_newline
+in_wait:	LDI	r2	in_dsr
+	BRzp	in_wait
+	STI	r0	in_ddr
+	ADD	r1	r1	#1
+	BRnzp	in_next
+in_newline:	LD	r0	in_lf
+in_wait_lf:	LDI	r2	in_dsr
+	BRzp	in_wait_lf
+	STI	r0	in_ddr
+in_read:	LDI	r0	in_kbsr
+	BRzp	in_read
+	LDI	r0	in_kbdr
+in_echo:	LDI	r2	in_dsr
+	BRzp	in_echo
+	STI	r0	in_ddr
+	LD	r1	in_r1
+	LD	r2	in_r2
+	RET
+in_kbsr:	.FILL	$FE00
+in_kbdr:	.FILL	$FE02
+in_dsr:	.FILL	$FE04
+in_ddr:	.FILL	$FE06
+in_lf:	.FILL	#10
+in_prompt:	.STRINGZ "Enter the character: "
+in_r1:	.BLKW	#1
+in_r2:	.BLKW	#1
+
+;; writes the string of two characters per word at r0, low byte first
+os_putsp:	ST	r0	putsp_r0
+	ST	r1	putsp_r1
+	ST	r2	putsp_r2
+	ST	r3	putsp_r3
+	ST	r4	putsp_r4
+putsp_next:	LDR	r1	r0	#0
+	BRz	putsp_done
+	LD	r2	putsp_low
+	AND	r2	r1	r2
+putsp_wait1:	LDI	r3	putsp_dsr
+	BRzp	putsp_wait1
+	STI	r2	putsp_ddr
+	AND	r2	r2	#0
+	AND	r4	r4	#0
+	ADD	r4	r4	#8
+putsp_shift:	ADD	r2	r2	r2
+	ADD	r1	r1	#0
+	BRzp	putsp_zero
+	ADD	r2	r2	#1
+putsp_zero:	ADD	r1	r1	r1
+	ADD	r4	r4	#-1
+	BRp	putsp_shift
+	ADD	r2	r2	#0
+	BRz	putsp_skip
+putsp_wait2:	LDI	r3	putsp_dsr
+	BRzp	putsp_wait2
+	STI	r2	putsp_ddr
+putsp_skip:	ADD	r0	r0	#1
+	BRnzp	putsp_next
+putsp_done:	LD	r0	putsp_r0
+	LD	r1	putsp_r1
+	LD	r2	putsp_r2
+	LD	r3	putsp_r3
+	LD	r4	putsp_r4
+	RET
+putsp_low:	.FILL	$00FF
+putsp_dsr:	.FILL	$FE04
+putsp_ddr:	.FILL	$FE06
+putsp_r0:	.BLKW	#1
+putsp_r1:	.BLKW	#1
+putsp_r2:	.BLKW	#1
+putsp_r3:	.BLKW	#1
+putsp_r4:	.BLKW	#1
+
+;; writes a message and stops the clock
+os_halt:	ST	r0	halt_r0
+	ST	r1	halt_r1
+	ST	r2	halt_r2
+	LEA	r0	halt_message
+halt_next:	LDR	r1	r0	#0
+	BRz	halt_newline
+halt_wait:	LDI	r2	halt_dsr
+	BRzp	halt_wait
+	STI	r1	halt_ddr
+	ADD	r0	r0	#1
+	BRnzp	halt_next
+halt_newline:	LD	r1	halt_lf
+halt_wait_lf:	LDI	r2	halt_dsr
+	BRzp	halt_wait_lf
+	STI	r1	halt_ddr
+	LDI	r1	halt_mcr
+	LD	r0	halt_clock
+	AND	r0	r1	r0
+	STI	r0	halt_mcr
+	LD	r0	halt_r0
+	LD	r1	halt_r1
+	LD	r2	halt_r2
+	RET
+halt_dsr:	.FILL	$FE04
+halt_ddr:	.FILL	$FE06
+halt_mcr:	.FILL	$FFFE
+halt_clock:	.FILL	$7FFF
+halt_lf:	.FILL	#10
+halt_message:	.FILL	#10
+	.STRINGZ "program finished"
+halt_r0:	.BLKW	#1
+halt_r1:	.BLKW	#1
+halt_r2:	.BLKW	#1
+	.END
@@ -0,0 +1,74 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "machine.h"
+#include "translation.h"
+
+// Exit statuses for programs stopped before they halted, as lc3 has them.
+static const int exit_instruction_limit = 3;
+static const int exit_time_limit = 4;
+static const int exit_output_limit = 5;
+static const int exit_end_of_input = 6;
+
+static
+int usage(const char* program)
+{
+    fprintf(stderr, "Usage: %s [--timeout seconds] [--max-instructions n] [--max-output bytes]\n",
+            program);
+    return EXIT_FAILURE;
+}
+
+// The main function of every program lc3aot translates: runs it like lc3
+// runs the object file, on ENGINE_AOT.
+int main(int argc, char** argv)
+{
+    lc3::limits_t limits;
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strcmp(arg, "--timeout") == 0 && i + 1 < argc) {
+            limits.seconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--max-instructions") == 0 && i + 1 < argc) {
+            limits.instructions = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(arg, "--max-output") == 0 && i + 1 < argc) {
+            limits.output = strtoull(argv[++i], nullptr, 10);
+        } else {
+            return usage(argv[0]);
+        }
+    }
+
+    lc3::stdio_console io(true);
+    lc3::machine machine;
+    machine.io = &io;
+    const lc3::translation_t& program = lc3::translated_program;
+    bool loaded = program.segmented ? machine.load_segmented(program.object, program.object_size)
+                                    : machine.load(program.object, program.object_size);
+    if (!loaded) {
+        fputs("error: the translated object file is malformed\n", stderr);
+        return EXIT_FAILURE;
+    }
+    machine.engine = lc3::ENGINE_AOT;
+    machine.translation = &program;
+    lc3::status_kind status = machine.run(limits);
+
+    io.flush();
+    switch (status) {
+    case lc3::STATUS_INVALID:
+        fputs("invalid operation: terminating", stderr);
+        return EXIT_FAILURE;
+    case lc3::STATUS_INSTRUCTION_LIMIT:
+        fputs("instruction limit reached\n", stderr);
+        return exit_instruction_limit;
+    case lc3::STATUS_TIME_LIMIT:
+        fputs("time limit reached\n", stderr);
+        return exit_time_limit;
+    case lc3::STATUS_OUTPUT_LIMIT:
+        fputs("output limit reached\n", stderr);
+        return exit_output_limit;
+    case lc3::STATUS_END_OF_INPUT:
+        fputs("the program read past the end of input\n", stderr);
+        return exit_end_of_input;
+    default:
+        return EXIT_SUCCESS;
+    }
+}
@@ -0,0 +1,839 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "assembler.h"
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+// Scans comments and strings 16 bytes at a time where SSE2 is available.
+#if defined(__SSE2__) || defined(_M_X64)
+#define LC3AL_SSE2 1
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace lc3 {
+
+using list_type = rks::list_pool<std::uint32_t, u16>::list_type;
+
+// Character classes for the lexer, looked up in a table rather than with
+// the locale-dependent <cctype> functions. Sources are read as ASCII.
+enum {
+    CHAR_BLANK = 1 << 0, // whitespace other than the '\n' that ends every line
+    CHAR_WORD_START = 1 << 1,
+    CHAR_LETTER = 1 << 2,
+    CHAR_DIGIT = 1 << 3,
+    CHAR_XDIGIT = 1 << 4,
+    CHAR_PRINT = 1 << 5,
+};
+
+struct char_classes_t {
+    unsigned char classes[256];
+};
+
+static constexpr
+char_classes_t make_char_classes()
+{
+    char_classes_t x = {};
+    for (int c = 0; c != 256; ++c) {
+        bool upper = c >= 'A' && c <= 'Z';
+        bool lower = c >= 'a' && c <= 'z';
+        bool digit = c >= '0' && c <= '9';
+        int classes = 0;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f') classes |= CHAR_BLANK;
+        if (upper || lower || c == '_' || c == '.') classes |= CHAR_WORD_START;
+        if (upper || lower || digit || c == '_') classes |= CHAR_LETTER;
+        if (digit) classes |= CHAR_DIGIT;
+        if (digit || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f')) classes |= CHAR_XDIGIT;
+        if (c >= 0x20 && c <= 0x7E) classes |= CHAR_PRINT;
+        x.classes[c] = static_cast<unsigned char>(classes);
+    }
+    return x;
+}
+
+static constexpr char_classes_t char_classes = make_char_classes();
+
+static inline
+bool is_char(char c, int classes)
+{
+    return (char_classes.classes[static_cast<unsigned char>(c)] & classes) != 0;
+}
+
+#if LC3AL_SSE2
+static inline
+int lowest_bit(unsigned x)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, x);
+    return static_cast<int>(i);
+#else
+    return __builtin_ctz(x);
+#endif
+}
+#endif
+
+// Returns the first a, b or c at or after p. One of them has to be '\n',
+// which ends every line, so the search never leaves the line. The SSE2
+// version only loads aligned blocks of 16 bytes, and so never touches a page
+// beyond the one holding that '\n'.
+static inline
+const char* find_first_of(const char* p, char a, char b, char c)
+{
+#if LC3AL_SSE2
+    const __m128i xa = _mm_set1_epi8(a);
+    const __m128i xb = _mm_set1_epi8(b);
+    const __m128i xc = _mm_set1_epi8(c);
+    auto matches = [&](const char* block) {
+        __m128i x = _mm_load_si128(reinterpret_cast<const __m128i*>(block));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, xa), _mm_cmpeq_epi8(x, xb)),
+                                    _mm_cmpeq_epi8(x, xc));
+        return static_cast<unsigned>(_mm_movemask_epi8(hits));
+    };
+    std::size_t offset = reinterpret_cast<std::uintptr_t>(p) & 15;
+    const char* block = p - offset;
+    unsigned mask = matches(block) & (0xFFFFu << offset);
+    while (!mask) {
+        block += 16;
+        mask = matches(block);
+    }
+    return block + lowest_bit(mask);
+#else
+    while (*p != a && *p != b && *p != c) ++p;
+    return p;
+#endif
+}
+
+void assembler::report(const char* format, va_list args)
+{
+    va_list size_args;
+    va_copy(size_args, args);
+    int size = vsnprintf(nullptr, 0, format, size_args);
+    va_end(size_args);
+    std::string message(size, '\0');
+    vsnprintf(&message[0], size + 1, format, args);
+    diagnostics.push_back(diagnostic_t{line_number, std::move(message)});
+}
+
+void assembler::error(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    report(format, args);
+    va_end(args);
+}
+
+// Reports an error assembly cannot carry on after, and stops it.
+void assembler::fatal_error(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    report(format, args);
+    va_end(args);
+    throw stop_t();
+}
+
+void assembler::next_token()
+{
+start:
+    while (is_char(*line_cursor, CHAR_BLANK)) ++line_cursor;
+    token.f = line_cursor;
+
+    // The '\n' is left for the next call to find again.
+    switch (*line_cursor) {
+    case '\n':
+        token.kind = TOKEN_EOL;
+        break;
+    case ';':
+        line_cursor = find_first_of(line_cursor, '\n', '\n', '\n');
+        token.kind = TOKEN_EOL;
+        break;
+    case ':':
+        ++line_cursor;
+        token.kind = TOKEN_COLON;
+        break;
+    case ',':
+        ++line_cursor;
+        token.kind = TOKEN_COMMA;
+        break;
+    case '$':
+        ++line_cursor;
+        token.kind = TOKEN_INTEGER;
+        token.base = 16;
+        if (*line_cursor == '-') ++line_cursor;
+        if (!is_char(*line_cursor, CHAR_XDIGIT)) {
+            token.kind = TOKEN_NONE;
+            break;
+        }
+        do ++line_cursor; while (is_char(*line_cursor, CHAR_XDIGIT));
+        break;
+    case '#':
+        ++line_cursor;
+        token.kind = TOKEN_INTEGER;
+        token.base = 10;
+        if (*line_cursor == '-') ++line_cursor;
+        if (!is_char(*line_cursor, CHAR_DIGIT)) {
+            token.kind = TOKEN_NONE;
+            break;
+        }
+        do ++line_cursor; while (is_char(*line_cursor, CHAR_DIGIT));
+        break;
+    case '"':
+        token.kind = TOKEN_STRING;
+        ++line_cursor;
+        while (true) {
+            line_cursor = find_first_of(line_cursor, '"', '\\', '\n');
+            if (line_cursor[0] != '\\') break;
+            line_cursor += line_cursor[1] == '"' ? 2 : 1;
+        }
+        if (*line_cursor != '"')
+            fatal_error("The string literal was not terminated");
+        ++line_cursor;
+        break;
+    default:
+        if (is_char(*line_cursor, CHAR_WORD_START)) {
+            token.kind = TOKEN_NAME;
+            do ++line_cursor; while (is_char(*line_cursor, CHAR_LETTER));
+        } else {
+            if (is_char(*line_cursor, CHAR_PRINT))
+                error("stray '%c' in program", *line_cursor);
+            else
+                error("stray 'x%x' in program", static_cast<unsigned char>(*line_cursor));
+            ++line_cursor;
+            goto start;
+        }
+        break;
+    }
+    token.l = line_cursor;
+}
+
+bool assembler::match(token_kind x)
+{
+    if (peek(x)) {
+        next_token();
+        return true;
+    }
+    return false;
+}
+
+assembler::token_t assembler::expect()
+{
+    token_t tmp = token;
+    next_token();
+    return tmp;
+}
+
+assembler::token_t assembler::expect(token_kind x)
+{
+    static const char* token_kind_names[] = {
+        "nothing", "a label", "a name", "an integer", "a register", "a string", "the end of the line",
+    };
+
+    if (!peek(x)) {
+        fatal_error("I was expecting %s but got '%.*s' instead",
+              token_kind_names[x], static_cast<int>(token.l - token.f), token.f);
+    }
+    return expect();
+}
+
+bool assembler::peek_register() const
+{
+    return peek(TOKEN_NAME) && (token.l - token.f == 2) &&
+        (token.f[0] == 'r' || token.f[0] == 'R') &&
+        (token.f[1] >= '0' && token.f[1] <= '7');
+}
+
+u16 assembler::expect_register()
+{
+    u16 reg;
+    if (peek_register()) {
+        reg = token.f[1] - '0';
+    } else {
+        reg = 0;
+        error("I was expecting a register but got '%.*s' instead",
+              static_cast<int>(token.l - token.f), token.f);
+    }
+    next_token();
+    return reg;
+}
+
+// FNV-1a.
+static inline
+std::uint32_t hash_name(const char* f, const char* l)
+{
+    std::uint32_t h = 2166136261u;
+    while (f != l) {
+        h ^= static_cast<unsigned char>(*f++);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+void assembler::grow_symbol_slots()
+{
+    std::vector<std::uint32_t> slots(symbol_slots.size() * 2);
+    std::size_t mask = slots.size() - 1;
+    for (std::uint32_t i = 0; i != symbols.size(); ++i) {
+        const char* f = symbol_name(symbols[i]);
+        std::size_t slot = hash_name(f, f + symbols[i].size) & mask;
+        while (slots[slot]) slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
+    }
+    symbol_slots.swap(slots);
+}
+
+assembler::symbol_t& assembler::get_symbol(const char* f, const char* l)
+{
+    std::size_t size = l - f;
+    std::size_t mask = symbol_slots.size() - 1;
+    std::size_t slot = hash_name(f, l) & mask;
+    while (std::uint32_t index = symbol_slots[slot]) {
+        symbol_t& symbol = symbols[index - 1];
+        if (symbol.size == size && std::equal(f, l, symbol_name(symbol)))
+            return symbol;
+        slot = (slot + 1) & mask;
+    }
+
+    symbols.push_back(symbol_t{static_cast<std::uint32_t>(symbol_names.size()),
+                               static_cast<std::uint32_t>(size), 0, 0});
+    symbol_names.append(f, l);
+    symbol_slots[slot] = static_cast<std::uint32_t>(symbols.size());
+    if (symbols.size() * 2 > symbol_slots.size()) grow_symbol_slots();
+    return symbols.back();
+}
+
+static inline
+int ordinal(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+    return -1;
+}
+
+template <typename I, typename N>
+std::pair<I, N> parse_integer_nonnegative(I f, I l, N x, int base)
+{
+    while (f != l) {
+        N digit = ordinal(*f);
+        if (x > (std::numeric_limits<N>::max() - digit) / base)
+            break;
+        x = x * base + digit;
+        ++f;
+    }
+    return std::make_pair(f, x);
+}
+
+template <typename I, typename N>
+std::pair<I, N> parse_integer_negative(I f, I l, N x, int base)
+{
+    while (f != l) {
+        N digit = ordinal(*f);
+        if (x < (std::numeric_limits<N>::min() + digit) / base)
+            break;
+        x = x * base - digit;
+        ++f;
+    }
+    return std::make_pair(f, x);
+}
+
+template <typename I, typename N>
+std::pair<I, N> parse_integer_unsigned(I f, I l, N x, int base)
+{
+    bool negate;
+    if (*f == '-') {
+        negate = true;
+        ++f;
+    } else negate = false;
+
+    std::pair<I, N> p = parse_integer_nonnegative(f, l, x, base);
+    if (negate) p.second = ~(p.second) + 1;
+    return p;
+}
+
+template <typename I, typename N>
+inline
+std::pair<I, N> parse_integer_signed(I f, I l, N x, int base)
+{
+    if (*f == '-') return parse_integer_negative(++f, l, x, base);
+    return parse_integer_nonnegative(f, l, x, base);
+}
+
+template <typename I, typename N>
+inline
+std::pair<I, N> parse_integer(I f, I l, N x, int base, std::true_type)
+{
+    return parse_integer_signed(f, l, x, base);
+}
+
+template <typename I, typename N>
+inline
+std::pair<I, N> parse_integer(I f, I l, N x, int base, std::false_type)
+{
+    return parse_integer_unsigned(f, l, x, base);
+}
+
+template <typename I, typename N>
+inline
+std::pair<I, N> parse_integer(I f, I l, N x, int base)
+{
+    return parse_integer(f, l, x, base, std::is_signed<N>());
+}
+
+// Indices into assembler::opcodes.
+namespace {
+enum {
+    OP_ADD,
+    OP_AND,
+    OP_BRn, OP_BRz, OP_BRp, OP_BR, OP_BRzp, OP_BRnp, OP_BRnz, OP_BRnzp,
+    OP_JMP, OP_RET,
+    OP_JSR, OP_JSRR,
+    OP_LD, OP_LDI, OP_LDR, OP_LEA,
+    OP_NOT,
+    OP_RTI,
+    OP_ST, OP_STI, OP_STR,
+    OP_TRAP,
+    OP_GETC, OP_OUT, OP_PUTS, OP_IN, OP_PUTSP, OP_HALT,
+    OP_ORIG, OP_END, OP_BLKW, OP_FILL, OP_STRINGZ,
+};
+} // namespace
+
+void assembler::print_listing(u16 x)
+{
+    char words[32];
+    listing.append(words, snprintf(words, sizeof(words), "%04x %04x", location_counter(), x));
+    if (line_number != listed_line_number) {
+        const char* end = line;
+        while (*end != '\n') ++end;
+        listing.append(words, snprintf(words, sizeof(words), " (%04d)\t", line_number));
+        listing.append(line, end);
+        listed_line_number = line_number;
+    }
+    listing += '\n';
+}
+
+void assembler::write_instruction(u16 x)
+{
+    if (object.size() - segments.back() - 2 >= 65536)
+        fatal_error("exceeded memory capacity");
+    print_listing(x);
+    object.push_back(x);
+}
+
+void assembler::assemble_add_and(const opcode_t* op)
+{
+    u16 base_code = op->base_code | (expect_register() << 9);
+    match(TOKEN_COMMA);
+
+    base_code |= (expect_register() << 6);
+    match(TOKEN_COMMA);
+
+    if (peek_register()) {
+        base_code |= expect_register();
+    } else if (peek(TOKEN_INTEGER)) {
+        token_t imm5 = expect();
+        auto pair = parse_integer(imm5.f + 1, imm5.l, std::int16_t(0), imm5.base);
+        if (pair.first != imm5.l || pair.second < -16 || pair.second > 16)
+            error("%.*s cannot be represented as a signed 5-bit integer",
+                  static_cast<int>(imm5.l - imm5.f), imm5.f);
+        base_code |= (1 << 5);
+        base_code |= static_cast<u16>(pair.second) & 0x1F;
+    } else {
+        fatal_error("I was expecting a register or an integer but got '%.*s' instead",
+              static_cast<int>(token.l - token.f), token.f);
+    }
+    write_instruction(base_code);
+}
+
+void assembler::assemble_label(symbol_t& symbol, u16 base_code, int n)
+{
+    if (symbol.line_number) {
+        int offset = symbol.location - (location_counter() + 1);
+        if (offset < -(1 << (n - 1))) error("offset too large");
+        base_code |= offset & ((1 << n) - 1);
+    } else {
+        symbol.location = pool.allocate(static_cast<std::uint32_t>(object.size()), symbol.location);
+    }
+    write_instruction(base_code);
+}
+
+void assembler::assemble_branch(const opcode_t* op)
+{
+    token_t name = expect(TOKEN_NAME);
+    symbol_t& symbol = get_symbol(name.f, name.l);
+    assemble_label(symbol, op->base_code, 9);
+}
+
+void assembler::assemble_jump(const opcode_t* op)
+{
+    write_instruction(op->base_code | (expect_register() << 6));
+}
+
+void assembler::assemble_jump_subroutine(const opcode_t* op)
+{
+    token_t name = expect(TOKEN_NAME);
+    symbol_t& symbol = get_symbol(name.f, name.l);
+    assemble_label(symbol, op->base_code, 11);
+}
+
+void assembler::assemble_load_store(const opcode_t* op)
+{
+    u16 base_code = op->base_code | (expect_register() << 9);
+    match(TOKEN_COMMA);
+    token_t label = expect(TOKEN_NAME);
+    symbol_t& symbol = get_symbol(label.f, label.l);
+    assemble_label(symbol, base_code, 9);
+}
+
+void assembler::assemble_load_store_relative(const opcode_t* op)
+{
+    u16 base_code = op->base_code | (expect_register() << 9);
+    match(TOKEN_COMMA);
+    base_code |= (expect_register() << 6);
+    match(TOKEN_COMMA);
+
+    token_t integer = expect(TOKEN_INTEGER);
+    auto pair = parse_integer(integer.f + 1, integer.l, u16(0), integer.base);
+    if (pair.first != integer.l)
+        fatal_error("cannot represent '%.*s' as a 16-bit unsigned integer",
+              static_cast<int>(integer.l - integer.f), integer.f);
+    write_instruction(base_code | pair.second);
+}
+
+void assembler::assemble_not(const opcode_t* op)
+{
+    u16 base_code = op->base_code | (expect_register() << 9);
+    match(TOKEN_COMMA);
+    write_instruction(base_code | (expect_register() << 6));
+}
+
+void assembler::assemble_trap(const opcode_t* op)
+{
+    token_t integer = expect(TOKEN_INTEGER);
+    auto pair = parse_integer(integer.f + 1, integer.l, u16(0), integer.base);
+    if (pair.first != integer.l || pair.second > 255)
+        fatal_error("cannot represent '%.*s' as 8-bit unsigned integer",
+              static_cast<int>(integer.l - integer.f), integer.f);
+    write_instruction(op->base_code | (pair.second & 0xFF));
+}
+
+void assembler::assemble_base_code(const opcode_t* op)
+{
+    write_instruction(op->base_code);
+}
+
+void assembler::directive_end(const opcode_t*)
+{
+    ended = true;
+}
+
+void assembler::directive_blkw(const opcode_t*)
+{
+    token_t integer = expect(TOKEN_INTEGER);
+    auto pair = parse_integer(integer.f + 1, integer.l, u16(0), integer.base);
+    if (pair.first != integer.l)
+        error("cannot represent '%.*s' as a 16-bit unsigned integer",
+              static_cast<int>(integer.l - integer.f), integer.f);
+    if ((65536 - location_counter()) < pair.second)
+        fatal_error("unable to reserve %d words, insufficient space",
+              static_cast<int>(pair.second));
+    while (pair.second--) write_instruction(0);
+}
+
+void assembler::directive_fill(const opcode_t*)
+{
+    token_t integer = expect(TOKEN_INTEGER);
+    auto pair = parse_integer(integer.f + 1, integer.l, u16(0), integer.base);
+    if (pair.first != integer.l)
+        fatal_error("cannot represent '%.*s' as a 16-bit unsigned integer",
+              static_cast<int>(integer.l - integer.f), integer.f);
+    write_instruction(pair.second);
+}
+
+void assembler::directive_stringz(const opcode_t*)
+{
+    token_t string = expect(TOKEN_STRING);
+    const char* f = string.f + 1;
+    const char* l = string.l - 1;
+    if ((65536 - location_counter()) < (l - f + 1))
+        fatal_error("The string is too large to fit in the available space");
+    write_instruction(static_cast<unsigned char>(*f++));
+    while (f != l) write_instruction(static_cast<unsigned char>(*f++));
+    write_instruction(0);
+}
+
+const assembler::opcode_t assembler::opcodes[] = {
+    { "ADD",      0x1000, &assembler::assemble_add_and },
+    { "AND",      0x5000, &assembler::assemble_add_and },
+    { "BRn",      0x0800, &assembler::assemble_branch },
+    { "BRz",      0x0400, &assembler::assemble_branch },
+    { "BRp",      0x0200, &assembler::assemble_branch },
+    { "BR",       0x0E00, &assembler::assemble_branch },
+    { "BRzp",     0x0600, &assembler::assemble_branch },
+    { "BRnp",     0x0A00, &assembler::assemble_branch },
+    { "BRnz",     0x0C00, &assembler::assemble_branch },
+    { "BRnzp",    0x0E00, &assembler::assemble_branch },
+    { "JMP",      0xC000, &assembler::assemble_jump },
+    { "RET",      0xC1C0, &assembler::assemble_base_code },
+    { "JSR",      0x4800, &assembler::assemble_jump_subroutine },
+    { "JSRR",     0x4000, &assembler::assemble_jump },
+    { "LD",       0x2000, &assembler::assemble_load_store },
+    { "LDI",      0xA000, &assembler::assemble_load_store },
+    { "LDR",      0x6000, &assembler::assemble_load_store_relative },
+    { "LEA",      0xE000, &assembler::assemble_load_store },
+    { "NOT",      0x903F, &assembler::assemble_not },
+    { "RTI",      0x8000, &assembler::assemble_base_code },
+    { "ST",       0x3000, &assembler::assemble_load_store },
+    { "STI",      0xB000, &assembler::assemble_load_store },
+    { "STR",      0x7000, &assembler::assemble_load_store_relative },
+    { "TRAP",     0xF000, &assembler::assemble_trap },
+    { "GETC",     0xF020, &assembler::assemble_base_code },
+    { "OUT",      0xF021, &assembler::assemble_base_code },
+    { "PUTS",     0xF022, &assembler::assemble_base_code },
+    { "IN",       0xF023, &assembler::assemble_base_code },
+    { "PUTSP",    0xF024, &assembler::assemble_base_code },
+    { "HALT",     0xF025, &assembler::assemble_base_code },
+    { ".ORIG",    0x0000, &assembler::directive_orig },
+    { ".END",     0x0000, &assembler::directive_end },
+    { ".BLKW",    0x0000, &assembler::directive_blkw },
+    { ".FILL",    0x0000, &assembler::directive_fill },
+    { ".STRINGZ", 0x0000, &assembler::directive_stringz },
+};
+
+// Mnemonics and directives are at most 8 characters long, so a name is
+// looked up by packing it, in upper case, into a 64-bit key.
+static constexpr std::size_t opcode_key_size = 8;
+
+static constexpr
+std::uint64_t opcode_key(const char* f, const char* l)
+{
+    std::uint64_t key = 0;
+    for (; f != l; ++f) {
+        char c = *f;
+        if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+        key = key << 8 | static_cast<unsigned char>(c);
+    }
+    return key;
+}
+
+template <std::size_t N>
+static constexpr
+std::uint64_t opcode_key(const char (&name)[N])
+{
+    static_assert(N - 1 <= opcode_key_size, "name too long for a key");
+    return opcode_key(name, name + N - 1);
+}
+
+const assembler::opcode_t* assembler::get_opcode(const char* f, const char* l)
+{
+    if (l - f > static_cast<std::ptrdiff_t>(opcode_key_size)) return std::end(opcodes);
+    switch (opcode_key(f, l)) {
+    case opcode_key("ADD"):      return &opcodes[OP_ADD];
+    case opcode_key("AND"):      return &opcodes[OP_AND];
+    case opcode_key("BRn"):      return &opcodes[OP_BRn];
+    case opcode_key("BRz"):      return &opcodes[OP_BRz];
+    case opcode_key("BRp"):      return &opcodes[OP_BRp];
+    case opcode_key("BR"):       return &opcodes[OP_BR];
+    case opcode_key("BRzp"):     return &opcodes[OP_BRzp];
+    case opcode_key("BRnp"):     return &opcodes[OP_BRnp];
+    case opcode_key("BRnz"):     return &opcodes[OP_BRnz];
+    case opcode_key("BRnzp"):    return &opcodes[OP_BRnzp];
+    case opcode_key("JMP"):      return &opcodes[OP_JMP];
+    case opcode_key("RET"):      return &opcodes[OP_RET];
+    case opcode_key("JSR"):      return &opcodes[OP_JSR];
+    case opcode_key("JSRR"):     return &opcodes[OP_JSRR];
+    case opcode_key("LD"):       return &opcodes[OP_LD];
+    case opcode_key("LDI"):      return &opcodes[OP_LDI];
+    case opcode_key("LDR"):      return &opcodes[OP_LDR];
+    case opcode_key("LEA"):      return &opcodes[OP_LEA];
+    case opcode_key("NOT"):      return &opcodes[OP_NOT];
+    case opcode_key("RTI"):      return &opcodes[OP_RTI];
+    case opcode_key("ST"):       return &opcodes[OP_ST];
+    case opcode_key("STI"):      return &opcodes[OP_STI];
+    case opcode_key("STR"):      return &opcodes[OP_STR];
+    case opcode_key("TRAP"):     return &opcodes[OP_TRAP];
+    case opcode_key("GETC"):     return &opcodes[OP_GETC];
+    case opcode_key("OUT"):      return &opcodes[OP_OUT];
+    case opcode_key("PUTS"):     return &opcodes[OP_PUTS];
+    case opcode_key("IN"):       return &opcodes[OP_IN];
+    case opcode_key("PUTSP"):    return &opcodes[OP_PUTSP];
+    case opcode_key("HALT"):     return &opcodes[OP_HALT];
+    case opcode_key(".ORIG"):    return &opcodes[OP_ORIG];
+    case opcode_key(".END"):     return &opcodes[OP_END];
+    case opcode_key(".BLKW"):    return &opcodes[OP_BLKW];
+    case opcode_key(".FILL"):    return &opcodes[OP_FILL];
+    case opcode_key(".STRINGZ"): return &opcodes[OP_STRINGZ];
+    }
+    return std::end(opcodes);
+}
+
+// The first two words of a segmented object file, "LC3S".
+static const u16 segmented_magic[2] = { 0x4C43, 0x3353 };
+
+// Runs for the first line of code whatever it holds, and for .ORIG after
+// that. Each .ORIG starts a segment, with its word count left to
+// finish_object.
+void assembler::directive_orig(const opcode_t* op)
+{
+    if (!originated) {
+        originated = true;
+        assert(object.size() == 0);
+        object.assign({segmented_magic[0], segmented_magic[1], 0});
+    }
+    segments.push_back(object.size());
+    object.push_back(0);
+    object.push_back(0);
+    if (op != &opcodes[OP_ORIG]) {
+        error("expected .ORIG as first instruction");
+        (this->*op->assemble)(op);
+    }
+
+    token_t integer = expect(TOKEN_INTEGER);
+    auto pair = parse_integer(integer.f + 1, integer.l, u16(0), integer.base);
+    if (pair.first != integer.l)
+        error("integer overflow: '%.*s'", static_cast<int>(integer.l - integer.f), integer.f);
+    print_listing(pair.second);
+    object[segments.back()] = pair.second;
+}
+
+// Fills in the offset of the instruction at place in object, now that the
+// label it refers to is at the location counter. The label can be in a
+// later segment at a lower address.
+void assembler::fix_forward_references(std::uint32_t place)
+{
+    std::size_t segment = *(std::upper_bound(segments.begin(), segments.end(), place) - 1);
+    u16 position = object[segment] + static_cast<u16>(place - segment - 2);
+    u16& instruction = object[place];
+    int offset = location_counter() - position;
+    switch (instruction >> 12) {
+    case 0: case 2: case 3: case 10: case 11: case 14:
+        if (offset - 1 > 255 || offset - 1 < -256) error("offset too large");
+        instruction |= static_cast<u16>(offset - 1) & 0x1FF;
+        break;
+    case 4:
+        if (offset - 1 > 1023 || offset - 1 < -1024) error("offset too large");
+        instruction |= static_cast<u16>(offset - 1) & 0x7FF;
+        break;
+    }
+}
+
+void assembler::assemble_line()
+{
+    next_token();
+    if (peek(TOKEN_EOL)) return;
+
+    token_t name = expect(TOKEN_NAME);
+    if (match(TOKEN_COLON)) {
+        symbol_t& symbol = get_symbol(name.f, name.l);
+        if (symbol.line_number) {
+            error("label '%.*s' already defined, see line %d",
+                  static_cast<int>(name.l - name.f), name.f,
+                  symbol.line_number);
+        } else {
+            list_type list = symbol.location;
+            while (!pool.is_end(list)) {
+                fix_forward_references(pool.value(list));
+                list = pool.free(list);
+            }
+            symbol.line_number = line_number;
+            symbol.location = location_counter();
+        }
+        name = expect(TOKEN_NAME);
+    }
+
+    const opcode_t* op = get_opcode(name.f, name.l);
+    if (op == std::end(opcodes)) {
+        error("unrecognized instruction '%.*s'",
+              static_cast<int>(name.l - name.f), name.f);
+        return;
+    }
+    if (originated) (this->*op->assemble)(op);
+    else directive_orig(op);
+    expect(TOKEN_EOL);
+}
+
+// Fills in the word counts and the entry, and with a single segment leaves
+// the plain object file: its origin followed by its words.
+void assembler::finish_object()
+{
+    if (segments.empty()) return;
+    for (std::size_t i = 0; i != segments.size(); ++i) {
+        std::size_t end = i + 1 != segments.size() ? segments[i + 1] : object.size();
+        object[segments[i] + 1] = static_cast<u16>(end - segments[i] - 2);
+    }
+    object[2] = object[segments[0]];
+    segmented = segments.size() > 1;
+    if (!segmented) {
+        object.erase(object.begin(), object.begin() + 3);
+        object.erase(object.begin() + 1);
+    }
+}
+
+// Assembles the lines in [f, l), the last of which ends in '\n', until .END.
+void assembler::assemble_lines(const char* f, const char* l)
+{
+    while (f != l && !ended) {
+        ++line_number;
+        line = f;
+        line_cursor = f;
+        assemble_line();
+        f = static_cast<const char*>(std::memchr(line_cursor, '\n', l - line_cursor)) + 1;
+    }
+}
+
+bool assembler::assemble(const char* f, const char* l)
+{
+    object.clear();
+    listing.clear();
+    diagnostics.clear();
+    stopped = false;
+    pool = rks::list_pool<std::uint32_t, u16>();
+    symbol_names.clear();
+    symbols.clear();
+    symbol_slots.assign(1024, 0);
+    line_number = 0;
+    listed_line_number = 0;
+    originated = false;
+    ended = false;
+    segmented = false;
+    segments.clear();
+
+    try {
+        // Lines are lexed where they lie in the source, each up to its
+        // '\n'. Only a last line without one is copied, to give it one.
+        const char* tail = l;
+        while (tail != f && tail[-1] != '\n') --tail;
+        assemble_lines(f, tail);
+        if (tail != l) {
+            std::string last(tail, l);
+            last += '\n';
+            assemble_lines(last.data(), last.data() + last.size());
+        }
+
+        listing += "\nSymbol Table\n------------\n";
+        for (const symbol_t& symbol : symbols) {
+            if (!symbol.line_number) {
+                error("undefined reference '%.*s'", static_cast<int>(symbol.size),
+                      symbol_name(symbol));
+            } else {
+                char location[32];
+                listing.append(location, snprintf(location, sizeof(location), "(%04d) %x ",
+                                                  symbol.line_number, symbol.location));
+                listing.append(symbol_name(symbol), symbol.size);
+                listing += '\n';
+            }
+        }
+    } catch (const stop_t&) {
+        stopped = true;
+    }
+    finish_object();
+    return diagnostics.empty();
+}
+
+} // namespace lc3
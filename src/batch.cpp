@@ -0,0 +1,292 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "batch.h"
+#include "lanes.h"
+#include "work_stealing.h"
+
+namespace {
+
+enum result_kind {
+    RESULT_PASS,
+    RESULT_FAIL,
+    RESULT_TIMEOUT,
+    RESULT_ERROR,
+};
+
+// Everything a program does before its first read of input is the same for
+// every job that runs it, so it is done once per object file and each job
+// starts from a snapshot taken at that point.
+struct prefix_t {
+    std::string object_filename;
+    std::string error;
+    lc3::status_kind status = lc3::STATUS_RUNNING;
+    lc3::snapshot state;
+    std::string output;
+    double seconds = 0;
+};
+
+struct job_t {
+    std::string object_filename;
+    std::string input_filename;
+    std::string expected_filename;
+    std::size_t prefix;
+
+    result_kind result;
+    std::string message;
+    lc3::u64 instructions;
+    std::size_t pages; // of memory the job wrote to, apart from the prefix
+    double seconds;
+};
+
+bool read_file(const std::string& filename, std::string& contents)
+{
+    std::ifstream file(filename, std::ios::binary);
+    if (!file) return false;
+    contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    return true;
+}
+
+using clock = std::chrono::steady_clock;
+
+void run_prefix(prefix_t& prefix, const lc3::limits_t& limits, lc3::engine_kind engine)
+{
+    clock::time_point start = clock::now();
+    std::unique_ptr<lc3::machine> machine(new lc3::machine);
+    lc3::string_console io;
+    io.end = lc3::console::empty;
+    machine->engine = engine;
+    machine->io = &io;
+
+    if (!machine->load(prefix.object_filename.c_str())) {
+        prefix.error = prefix.object_filename + ": " + strerror(errno);
+        return;
+    }
+    prefix.status = machine->run(limits);
+    prefix.state = machine->save();
+    prefix.output = std::move(io.output);
+    prefix.seconds = std::chrono::duration<double>(clock::now() - start).count();
+}
+
+// A job forked from its prefix and waiting to be run and judged.
+struct fork_t {
+    lc3::string_console io;
+    std::string expected;
+    std::unique_ptr<lc3::machine> machine;
+};
+
+// Whatever the prefix used up counts against the job's limits.
+lc3::limits_t rest_of(const lc3::limits_t& limits, const prefix_t& prefix)
+{
+    lc3::limits_t rest = limits;
+    rest.instructions -= std::min(rest.instructions, prefix.state.instructions);
+    rest.seconds -= prefix.seconds;
+    rest.output -= std::min<lc3::u64>(rest.output, prefix.output.size());
+    return rest;
+}
+
+// Reads the job's input and expected output and forks its machine from the
+// prefix. Returns false, with the job judged, when there is nothing to run.
+bool start_job(job_t& job, const prefix_t& prefix, lc3::engine_kind engine, fork_t& fork)
+{
+    job.instructions = 0;
+    job.pages = 0;
+    job.seconds = prefix.seconds;
+
+    if (!prefix.error.empty()) {
+        job.result = RESULT_ERROR;
+        job.message = prefix.error;
+        return false;
+    }
+    if (job.input_filename != "-" && !read_file(job.input_filename, fork.io.input)) {
+        job.result = RESULT_ERROR;
+        job.message = job.input_filename + ": " + strerror(errno);
+        return false;
+    }
+    if (job.expected_filename != "-" && !read_file(job.expected_filename, fork.expected)) {
+        job.result = RESULT_ERROR;
+        job.message = job.expected_filename + ": " + strerror(errno);
+        return false;
+    }
+
+    fork.machine.reset(new lc3::machine(prefix.state));
+    fork.machine->engine = engine;
+    fork.machine->io = &fork.io;
+    fork.io.output = prefix.output;
+    return true;
+}
+
+// Judges the job by how its machine stopped and what it printed.
+void finish_job(job_t& job, const fork_t& fork, lc3::status_kind status, double seconds)
+{
+    const lc3::machine* machine = fork.machine.get();
+    const lc3::string_console& io = fork.io;
+    const std::string& expected = fork.expected;
+    job.instructions = machine->instructions;
+    job.pages = machine->private_pages();
+    job.seconds += seconds;
+
+    switch (status) {
+    case lc3::STATUS_TIME_LIMIT:
+        job.result = RESULT_TIMEOUT;
+        return;
+    case lc3::STATUS_INSTRUCTION_LIMIT:
+        job.result = RESULT_TIMEOUT;
+        job.message = "instruction limit reached";
+        return;
+    case lc3::STATUS_OUTPUT_LIMIT:
+        job.result = RESULT_ERROR;
+        job.message = "output limit reached";
+        return;
+    case lc3::STATUS_END_OF_INPUT:
+        job.result = RESULT_ERROR;
+        job.message = "read past the end of input";
+        return;
+    case lc3::STATUS_INVALID: {
+        job.result = RESULT_ERROR;
+        char buffer[64];
+        sprintf(buffer, "invalid operation at x%04X", machine->program_counter);
+        job.message = buffer;
+        return;
+    }
+    default:
+        break;
+    }
+    if (job.expected_filename == "-" || io.output == expected) {
+        job.result = RESULT_PASS;
+        return;
+    }
+
+    std::size_t i = 0;
+    while (i < io.output.size() && i < expected.size() && io.output[i] == expected[i]) ++i;
+    std::ostringstream message;
+    message << "output differs at byte " << i << " (got " << io.output.size()
+            << " bytes, expected " << expected.size() << ")";
+    job.result = RESULT_FAIL;
+    job.message = message.str();
+}
+
+void run_job(job_t& job, const prefix_t& prefix, const lc3::limits_t& limits,
+             lc3::engine_kind engine)
+{
+    clock::time_point start = clock::now();
+    fork_t fork;
+    if (!start_job(job, prefix, engine, fork)) return;
+    lc3::status_kind status = prefix.status;
+    if (status == lc3::STATUS_WAITING) status = fork.machine->run(rest_of(limits, prefix));
+    finish_job(job, fork, status, std::chrono::duration<double>(clock::now() - start).count());
+}
+
+// Runs jobs that share a prefix together on lc3::run_lanes.
+void run_group(job_t* const* group, std::size_t count, const prefix_t& prefix,
+               const lc3::limits_t& limits, lc3::engine_kind engine)
+{
+    clock::time_point start = clock::now();
+    std::vector<fork_t> forks(count);
+    std::vector<lc3::machine*> machines;
+    std::vector<std::size_t> started;
+    for (std::size_t i = 0; i != count; ++i) {
+        if (!start_job(*group[i], prefix, engine, forks[i])) continue;
+        started.push_back(i);
+        machines.push_back(forks[i].machine.get());
+    }
+
+    std::vector<lc3::status_kind> statuses(machines.size(), prefix.status);
+    if (prefix.status == lc3::STATUS_WAITING)
+        lc3::run_lanes(machines.data(), machines.size(), rest_of(limits, prefix), statuses.data());
+
+    double seconds = std::chrono::duration<double>(clock::now() - start).count();
+    for (std::size_t i = 0; i != started.size(); ++i)
+        finish_job(*group[started[i]], forks[started[i]], statuses[i], seconds);
+}
+
+bool read_manifest(const char* filename, std::vector<job_t>& jobs)
+{
+    std::ifstream manifest(filename);
+    if (!manifest) return false;
+
+    std::string line;
+    while (std::getline(manifest, line)) {
+        std::istringstream fields(line);
+        job_t job;
+        if (!(fields >> job.object_filename) || job.object_filename[0] == '#') continue;
+        if (!(fields >> job.input_filename)) job.input_filename = "-";
+        if (!(fields >> job.expected_filename)) job.expected_filename = "-";
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+} // namespace
+
+int run_batch(const char* manifest_filename, unsigned threads, const lc3::limits_t& limits,
+              lc3::engine_kind engine, bool lanes)
+{
+    std::vector<job_t> jobs;
+    if (!read_manifest(manifest_filename, jobs)) {
+        fprintf(stderr, "lc3: error: %s: %s\n", manifest_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    std::vector<prefix_t> prefixes;
+    std::map<std::string, std::size_t> prefix_index;
+    for (job_t& job : jobs) {
+        auto inserted = prefix_index.emplace(job.object_filename, prefixes.size());
+        if (inserted.second) {
+            prefixes.emplace_back();
+            prefixes.back().object_filename = job.object_filename;
+        }
+        job.prefix = inserted.first->second;
+    }
+
+    rks::parallel_for_stealing(prefixes.size(), threads, [&prefixes, &limits, engine](std::size_t i) {
+        run_prefix(prefixes[i], limits, engine);
+    });
+    if (lanes) {
+        // Up to a group's worth of jobs at a time for each prefix.
+        std::vector<std::vector<job_t*>> groups;
+        std::vector<std::size_t> open(prefixes.size(), std::size_t(-1));
+        for (job_t& job : jobs) {
+            std::size_t& group = open[job.prefix];
+            if (group == std::size_t(-1) || groups[group].size() == lc3::lane_width) {
+                group = groups.size();
+                groups.emplace_back();
+            }
+            groups[group].push_back(&job);
+        }
+        rks::parallel_for_stealing(groups.size(), threads, [&groups, &prefixes, &limits, engine](std::size_t i) {
+            const std::vector<job_t*>& group = groups[i];
+            run_group(group.data(), group.size(), prefixes[group[0]->prefix], limits, engine);
+        });
+    } else {
+        rks::parallel_for_stealing(jobs.size(), threads, [&jobs, &prefixes, &limits, engine](std::size_t i) {
+            run_job(jobs[i], prefixes[jobs[i].prefix], limits, engine);
+        });
+    }
+
+    static const char* result_names[] = { "PASS", "FAIL", "TIMEOUT", "ERROR" };
+    int counts[4] = {};
+    for (const job_t& job : jobs) {
+        ++counts[job.result];
+        printf("%-7s %s %s %s: %llu instructions, %zu pages in %.3fs",
+               result_names[job.result], job.object_filename.c_str(),
+               job.input_filename.c_str(), job.expected_filename.c_str(),
+               static_cast<unsigned long long>(job.instructions), job.pages, job.seconds);
+        if (!job.message.empty()) printf(": %s", job.message.c_str());
+        putchar('\n');
+    }
+    printf("%d passed, %d failed, %d timed out, %d errors\n",
+           counts[RESULT_PASS], counts[RESULT_FAIL], counts[RESULT_TIMEOUT], counts[RESULT_ERROR]);
+    return counts[RESULT_PASS] == static_cast<int>(jobs.size()) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "machine.h"
+
+// Runs every job listed in the manifest on `threads` threads and prints one
+// result line per job followed by a summary. Each manifest line names an
+// object file, optionally followed by a file to use as input and a file
+// holding the expected output; '-' stands for no input or no expectation.
+// Blank lines and lines starting with '#' are ignored. Every job runs under
+// the same limits. With lanes set, jobs that run the same object file are run
+// together on lc3::run_lanes, and the time limit is for each group of them.
+// Returns the process exit status.
+int run_batch(const char* manifest_filename, unsigned threads, const lc3::limits_t& limits,
+              lc3::engine_kind engine, bool lanes);
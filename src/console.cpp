@@ -0,0 +1,130 @@
+#include <algorithm>
+#include "console.h"
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace lc3 {
+
+stdio_console::stdio_console(bool writer_thread)
+{
+    buffer.reserve(capacity);
+    pending.reserve(capacity);
+    if (writer_thread) writer = std::thread(&stdio_console::write_pending, this);
+}
+
+stdio_console::~stdio_console()
+{
+    flush();
+    if (writer.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        writer.join();
+    }
+}
+
+// Reads whatever stdin has, waiting for at least a byte. Returns false at the
+// end of input.
+bool stdio_console::fill_input()
+{
+#ifdef _WIN32
+    int n = _read(0, input, sizeof(input));
+#else
+    ssize_t n = read(0, input, sizeof(input));
+#endif
+    if (n <= 0) return false;
+    input_first = 0;
+    input_last = static_cast<std::size_t>(n);
+    return true;
+}
+
+int stdio_console::get()
+{
+    if (input_first == input_last) {
+        // Whatever the program printed is most likely a prompt.
+        flush();
+        if (!fill_input()) return EOF;
+    }
+    return static_cast<unsigned char>(input[input_first++]);
+}
+
+int stdio_console::try_get()
+{
+#ifndef _WIN32
+    if (input_first == input_last) {
+        pollfd stdin_fd{0, POLLIN, 0};
+        if (poll(&stdin_fd, 1, 0) != 1) return empty;
+    }
+#endif
+    return get();
+}
+
+void stdio_console::write(const char* s, std::size_t n)
+{
+    while (n != 0) {
+        std::size_t count = std::min(n, capacity - buffer.size());
+        buffer.append(s, count);
+        s += count;
+        n -= count;
+        if (buffer.size() >= capacity) drain();
+    }
+}
+
+void stdio_console::flush()
+{
+    drain();
+    if (writer.joinable()) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !busy; });
+    }
+    fflush(stdout);
+}
+
+// Hands the buffer to the writer thread, or writes it out when there is none.
+void stdio_console::drain()
+{
+    if (buffer.empty()) return;
+    if (!writer.joinable()) {
+        fwrite(buffer.data(), 1, buffer.size(), stdout);
+        buffer.clear();
+        return;
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return !busy; });
+        buffer.swap(pending);
+        busy = true;
+    }
+    changed.notify_all();
+    buffer.clear();
+}
+
+void stdio_console::write_pending()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return busy || stopping; });
+        if (!busy) return;
+        lock.unlock();
+        fwrite(pending.data(), 1, pending.size(), stdout);
+        fflush(stdout);
+        lock.lock();
+        busy = false;
+        changed.notify_all();
+    }
+}
+
+console& standard_console()
+{
+    static stdio_console x;
+    return x;
+}
+
+} // namespace lc3
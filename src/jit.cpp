@@ -0,0 +1,671 @@
+#include <cassert>
+#include <cstddef>
+#include <algorithm>
+#include <initializer_list>
+#include "jit.h"
+
+// Guest registers and memory stay where the machine keeps them; the generated
+// code holds their addresses in callee-saved registers:
+//
+//   rbp  frame_t      rbx  registers          r12  machine::readable
+//   r13  flags                                r14  translated
+//   r15  block table
+//
+// Condition codes are lazy: instructions that set them leave their result,
+// sign-extended, in r13 and a BR tests r13 directly. Within a block only the
+// last such instruction before a store or the end of the block updates r13.
+// The flags live in frame_t between calls and are turned back into
+// machine::condition_register whenever the machine takes over.
+//
+// A block ends at the first control transfer or after max_block
+// instructions. On entry it charges its length to frame_t::budget, or leaves
+// with exit_budget when the budget cannot cover it. Direct exits look the
+// target up in the block table and jump straight to it when it has been
+// translated, otherwise they return the target address to run. TRAP, RTI,
+// invalid opcodes and LD, LDI, ST and STI of a device register are never
+// translated; run hands them to machine::step.
+//
+// Loads go through the machine's page table. A store to a page the machine
+// does not own yet, and a load or store through a pointer that turns out to
+// be a device register, leaves the block before the instruction so that step
+// can run it.
+//
+// The code buffer is never writable and executable at once: translate opens
+// the part it is about to fill for writing and hands it back read-only and
+// executable before any of it runs.
+#if defined(__x86_64__) && !defined(_WIN32)
+#define LC3_JIT 1
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace lc3 {
+
+#if LC3_JIT
+
+using u8 = std::uint8_t;
+
+static const std::size_t buffer_size = std::size_t(16) << 20;
+static const int max_block = 64;
+
+// The most code a single instruction emits; an STI, the longest, comes to
+// 133 bytes. Around its instructions a block adds at most the length check
+// on entry, the exit after max_block instructions and the bail-out.
+static const std::size_t max_instruction_bytes = 160;
+static const std::size_t max_frame_bytes = 64;
+static const std::size_t max_block_bytes = max_frame_bytes + max_block * max_instruction_bytes;
+// Room for the prologue and epilogue at the start of the buffer.
+static const std::size_t max_entry_bytes = 64;
+static_assert(max_entry_bytes + max_block_bytes <= buffer_size, "a block must fit in the buffer");
+
+// The value returned by generated code: the next program counter in the low
+// 16 bits and flags above it. With exit_store the upper 32 bits hold the
+// address of a store that hit translated code; exit_shared means the next
+// instruction has to run on step.
+static const u64 exit_store = u64(1) << 16;
+static const u64 exit_budget = u64(1) << 17;
+static const u64 exit_shared = u64(1) << 18;
+
+static const u8 budget_offset = offsetof(jit::frame_t, budget);
+static const u8 writable_offset = offsetof(jit::frame_t, writable);
+
+// Where a block has to give back part of the length it charged on entry,
+// should it leave after its first `executed` instructions.
+struct refund_t {
+    u8* p;
+    int executed;
+};
+
+struct emitter_t {
+    u8* p;
+    const u8* epilogue;
+
+    void byte(u8 x) { *p++ = x; }
+
+    void bytes(std::initializer_list<u8> xs)
+    {
+        for (u8 x : xs) byte(x);
+    }
+
+    void imm16(u16 x)
+    {
+        byte(x & 0xFF);
+        byte(x >> 8);
+    }
+
+    void imm32(std::uint32_t x)
+    {
+        for (int i = 0; i < 4; ++i) byte((x >> (i * 8)) & 0xFF);
+    }
+
+    void rel32(const void* target)
+    {
+        imm32(static_cast<std::uint32_t>(static_cast<const u8*>(target) - (p + 4)));
+    }
+
+    // movzx eax/ecx, word [rbx + 2 * r]
+    void load_register(u16 r, u8 reg = 0) { bytes({0x0F, 0xB7, u8(0x43 | reg << 3), u8(r * 2)}); }
+
+    // mov [rbx + 2 * r], ax/cx
+    void store_register(u16 r, u8 reg = 0) { bytes({0x66, 0x89, u8(0x43 | reg << 3), u8(r * 2)}); }
+
+    void mov_eax(std::uint32_t x) { byte(0xB8); imm32(x); }
+
+    // movzx eax, ax
+    void zero_extend() { bytes({0x0F, 0xB7, 0xC0}); }
+
+    // Leaves through the epilogue before the instruction at self, the n-th
+    // of its block, when the address in eax is a device register.
+    void check_device(u16 self, int n, refund_t*& refunds)
+    {
+        byte(0x3D); imm32(DEVICE_BASE);        // cmp eax, DEVICE_BASE
+        bytes({0x72, 18});                     // jb +18
+        bytes({0x48, 0x81, 0x45, budget_offset}); // add qword [rbp + budget], imm32
+        *refunds++ = refund_t{p, n};
+        imm32(0);
+        mov_eax(static_cast<std::uint32_t>(exit_shared | self));
+        jump_epilogue();
+    }
+
+    // Loads the word at the address in eax into eax.
+    void load_memory()
+    {
+        bytes({0x89, 0xC2});                   // mov edx, eax
+        bytes({0xC1, 0xEA, u8(machine::page_bits)}); // shr edx, page_bits
+        bytes({0x49, 0x8B, 0x14, 0xD4});       // mov rdx, [r12 + 8 * rdx]
+        byte(0x25); imm32(machine::page_size - 1); // and eax, page_size - 1
+        bytes({0x0F, 0xB7, 0x04, 0x42});       // movzx eax, word [rdx + 2 * rax]
+    }
+
+    // Stores cx to the address in eax for the instruction at self, the
+    // n-th of its block. Leaves through the epilogue before the store when
+    // the page is shared, and with exit_store after it when the word belongs
+    // to a translated block.
+    void store_memory(u16 self, int n, refund_t*& refunds)
+    {
+        bytes({0x89, 0xC2});                   // mov edx, eax
+        bytes({0xC1, 0xEA, u8(machine::page_bits)}); // shr edx, page_bits
+        bytes({0x4C, 0x8B, 0x45, writable_offset}); // mov r8, [rbp + writable]
+        bytes({0x49, 0x8B, 0x14, 0xD0});       // mov rdx, [r8 + 8 * rdx]
+        bytes({0x48, 0x85, 0xD2});             // test rdx, rdx
+        bytes({0x75, 18});                     // jnz +18
+        bytes({0x48, 0x81, 0x45, budget_offset}); // add qword [rbp + budget], imm32
+        *refunds++ = refund_t{p, n};
+        imm32(0);
+        mov_eax(static_cast<std::uint32_t>(exit_shared | self));
+        jump_epilogue();
+        bytes({0x41, 0x89, 0xC0});             // mov r8d, eax
+        bytes({0x41, 0x81, 0xE0}); imm32(machine::page_size - 1); // and r8d, page_size - 1
+        bytes({0x66, 0x42, 0x89, 0x0C, 0x42}); // mov [rdx + 2 * r8], cx
+
+        bytes({0x41, 0x80, 0x3C, 0x06, 0x00}); // cmp byte [r14 + rax], 0
+        bytes({0x74, 23});                     // je +23
+        bytes({0x48, 0x81, 0x45, budget_offset}); // add qword [rbp + budget], imm32
+        *refunds++ = refund_t{p, n + 1};
+        imm32(0);
+        bytes({0x48, 0xC1, 0xE0, 0x20});       // shl rax, 32
+        bytes({0x48, 0x0D});                   // or rax, imm32
+        imm32(static_cast<std::uint32_t>(exit_store | u16(self + 1)));
+        jump_epilogue();
+    }
+
+    // Makes ax the value the condition codes come from.
+    void set_flags() { bytes({0x44, 0x0F, 0xBF, 0xE8}); } // movsx r13d, ax
+
+    void jump_epilogue() { byte(0xE9); rel32(epilogue); }
+
+    // Continues at a known address: through the block table when the target
+    // has been translated, otherwise back to run.
+    void exit_direct(u16 target)
+    {
+        bytes({0x49, 0x8B, 0x87}); imm32(target * 8u); // mov rax, [r15 + 8 * target]
+        bytes({0x48, 0x85, 0xC0});                     // test rax, rax
+        bytes({0x74, 0x02});                           // jz +2
+        bytes({0xFF, 0xE0});                           // jmp rax
+        mov_eax(target);
+        jump_epilogue();
+    }
+
+    // Continues at the address in eax.
+    void exit_indirect()
+    {
+        bytes({0x49, 0x8B, 0x14, 0xC7}); // mov rdx, [r15 + 8 * rax]
+        bytes({0x48, 0x85, 0xD2});       // test rdx, rdx
+        bytes({0x74, 0x02});             // jz +2
+        bytes({0xFF, 0xE2});             // jmp rdx
+        jump_epilogue();
+    }
+};
+
+// The jcc opcode byte (after 0x0F) that branches when the nzp mask matches
+// the flags in r13; mask 0 and 7 need no test.
+static
+u8 branch_condition(u16 nzp)
+{
+    switch (nzp) {
+    case FLAG_NEGATIVE:                 return 0x88; // js
+    case FLAG_ZERO:                     return 0x84; // je
+    case FLAG_POSITIVE:                 return 0x8F; // jg
+    case FLAG_NEGATIVE | FLAG_ZERO:     return 0x8E; // jle
+    case FLAG_NEGATIVE | FLAG_POSITIVE: return 0x85; // jne
+    default:                            return 0x89; // jns
+    }
+}
+
+static
+u64 flags_from(u16 condition_register)
+{
+    if (condition_register & FLAG_NEGATIVE) return ~u64(0);
+    if (condition_register & FLAG_ZERO) return 0;
+    return 1;
+}
+
+static
+u16 condition_codes_from(u64 flags)
+{
+    std::int32_t x = static_cast<std::int32_t>(flags);
+    if (x == 0) return FLAG_ZERO;
+    if (x < 0) return FLAG_NEGATIVE;
+    return FLAG_POSITIVE;
+}
+
+// What the flag analysis in translate needs to know about an opcode.
+static
+bool sets_flags(u16 opcode)
+{
+    return opcode == OP_ADD || opcode == OP_AND || opcode == OP_NOT || opcode == OP_LEA
+        || opcode == OP_LD || opcode == OP_LDI || opcode == OP_LDR;
+}
+
+// Whether the block can be left just before the instruction.
+static
+bool may_leave(u16 opcode)
+{
+    return opcode == OP_ST || opcode == OP_STI || opcode == OP_STR
+        || opcode == OP_LDI || opcode == OP_LDR;
+}
+
+static
+bool translatable(u16 instruction, u16 address)
+{
+    switch (instruction >> 12) {
+    case OP_TRAP:
+    case OP_RTI:
+    case OP_INVALID:
+        return false;
+    case OP_LD:
+    case OP_LDI:
+    case OP_ST:
+    case OP_STI:
+        return u16(address + 1 + sign_extend_mask(instruction, 9)) < DEVICE_BASE;
+    }
+    return true;
+}
+
+static
+bool ends_block(u16 opcode)
+{
+    return opcode == OP_BR || opcode == OP_JSR || opcode == OP_JMP
+        || opcode == OP_TRAP || opcode == OP_RTI || opcode == OP_INVALID;
+}
+
+static
+void patch32(u8* p, std::uint32_t x)
+{
+    emitter_t e{p, nullptr};
+    e.imm32(x);
+}
+
+bool jit::available()
+{
+    return true;
+}
+
+jit::jit(machine& m) :
+    m(m),
+    blocks(new void*[machine::memory_size]),
+    block_last(new u16[machine::memory_size]),
+    translated(new u8[machine::memory_size])
+{
+    frame.registers = m.registers;
+    frame.readable = m.readable;
+    frame.writable = m.writable;
+    frame.flags = 0;
+    frame.translated = translated.get();
+    frame.blocks = blocks.get();
+    frame.budget = 0;
+
+    void* p = mmap(nullptr, buffer_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p != MAP_FAILED) buffer = static_cast<u8*>(p);
+    reset();
+}
+
+jit::~jit()
+{
+    if (buffer) munmap(buffer, buffer_size);
+}
+
+// Makes the code in [f, l) writable, or executable again. Without W^X from
+// the system there is no JIT: the buffer goes and run falls back on step.
+bool jit::protect(u8* f, u8* l, bool writing)
+{
+    std::uintptr_t page = static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE));
+    std::uintptr_t first = reinterpret_cast<std::uintptr_t>(f) & ~(page - 1);
+    std::uintptr_t last = (reinterpret_cast<std::uintptr_t>(l) + page - 1) & ~(page - 1);
+    int prot = writing ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC;
+    if (mprotect(reinterpret_cast<void*>(first), last - first, prot) == 0) return true;
+
+    std::fill(blocks.get(), blocks.get() + machine::memory_size, nullptr);
+    munmap(buffer, buffer_size);
+    buffer = nullptr;
+    return false;
+}
+
+void jit::reset()
+{
+    std::fill(blocks.get(), blocks.get() + machine::memory_size, nullptr);
+    std::fill(translated.get(), translated.get() + machine::memory_size, u8(0));
+    if (!buffer || !protect(buffer, buffer + max_entry_bytes, true)) return;
+
+    emitter_t e{buffer, nullptr};
+    entry = reinterpret_cast<u64 (*)(frame_t*, const void*)>(e.p);
+    e.bytes({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push rbx, rbp, r12-r15
+    e.bytes({0x48, 0x89, 0xFD});       // mov rbp, rdi
+    e.bytes({0x48, 0x8B, 0x5D, 0x00}); // mov rbx, [rbp]
+    e.bytes({0x4C, 0x8B, 0x65, 0x08}); // mov r12, [rbp + 8]
+    e.bytes({0x4C, 0x8B, 0x6D, 0x10}); // mov r13, [rbp + 16]
+    e.bytes({0x4C, 0x8B, 0x75, 0x18}); // mov r14, [rbp + 24]
+    e.bytes({0x4C, 0x8B, 0x7D, 0x20}); // mov r15, [rbp + 32]
+    e.bytes({0xFF, 0xE6});             // jmp rsi
+    epilogue = e.p;
+    e.bytes({0x4C, 0x89, 0x6D, 0x10}); // mov [rbp + 16], r13
+    e.bytes({0x41, 0x5F, 0x41, 0x5E, 0x41, 0x5D, 0x41, 0x5C, 0x5D, 0x5B, 0xC3}); // pop r15-r12, rbp, rbx; ret
+    assert(std::size_t(e.p - buffer) <= max_entry_bytes);
+    cursor = e.p;
+    protect(buffer, cursor, false);
+}
+
+void jit::invalidate(u16 address)
+{
+    if (!translated[address]) return;
+
+    u16 lo = address;
+    u16 hi = address;
+    for (int i = 0; i < max_block; ++i) {
+        u16 start = address - i;
+        if (blocks[start] && u16(block_last[start] - start) >= i) {
+            blocks[start] = nullptr;
+            if (u16(address - start) > u16(address - lo)) lo = start;
+            if (u16(block_last[start] - address) > u16(hi - address)) hi = block_last[start];
+        }
+    }
+    for (u16 a = lo; ; ++a) {
+        translated[a] = 0;
+        if (a == hi) break;
+    }
+    // Blocks that survive may still overlap the range just cleared.
+    for (int i = 0; i <= max_block + u16(hi - lo); ++i) {
+        u16 start = hi - i;
+        if (!blocks[start]) continue;
+        for (u16 a = start; ; ++a) {
+            translated[a] = 1;
+            if (a == block_last[start]) break;
+        }
+    }
+}
+
+// Returns nullptr when the instruction at start cannot be translated.
+void* jit::translate(u16 start)
+{
+    u16 instruction = m.read(start);
+    u16 opcode = instruction >> 12;
+    if (!translatable(instruction, start) || !buffer) return nullptr;
+
+    if (std::size_t(buffer + buffer_size - cursor) < max_block_bytes)
+        reset();
+    if (!buffer || !protect(cursor, cursor + max_block_bytes, true)) return nullptr;
+
+    emitter_t e{cursor, epilogue};
+    e.bytes({0x48, 0x81, 0x7D, budget_offset}); // cmp qword [rbp + budget], length
+    u8* check_length = e.p;
+    e.imm32(0);
+    e.bytes({0x0F, 0x82});                       // jb bail
+    u8* bail = e.p;
+    e.imm32(0);
+    e.bytes({0x48, 0x81, 0x6D, budget_offset}); // sub qword [rbp + budget], length
+    u8* charge_length = e.p;
+    e.imm32(0);
+
+    refund_t refunds[3 * max_block];
+    refund_t* refunds_end = refunds;
+
+    // The flags only have to be right where the block can be left: at stores,
+    // at loads through a pointer and at its end.
+    bool flags_live[max_block];
+    {
+        int last = 0;
+        int setter = -1;
+        for (; last < max_block; ++last) {
+            u16 x = m.read(u16(start + last));
+            u16 op = x >> 12;
+            flags_live[last] = false;
+            if (!translatable(x, u16(start + last))) break;
+            if (may_leave(op) && setter != -1) {
+                flags_live[setter] = true;
+                setter = -1;
+            }
+            if (sets_flags(op)) setter = last;
+            if (ends_block(op)) break;
+        }
+        if (setter != -1) flags_live[setter] = true;
+    }
+
+    u16 address = start;
+    int n = 0;
+#ifndef NDEBUG
+    const u8* body = e.p;
+#endif
+    for (;; ++n) {
+        assert(std::size_t(e.p - body) <= n * max_instruction_bytes);
+        if (n == max_block) {
+            e.exit_direct(address);
+            break;
+        }
+
+        instruction = m.read(address);
+        opcode = instruction >> 12;
+        u16 next = address + 1;
+        u16 destination = (instruction >> 9) & 0x7;
+        u16 source1 = (instruction >> 6) & 0x7;
+
+        if (!translatable(instruction, address)) {
+            e.exit_direct(address);
+            break;
+        }
+
+        translated[address] = 1;
+        block_last[start] = address;
+        address = next;
+
+        switch (opcode) {
+        case OP_ADD:
+        case OP_AND: {
+            e.load_register(source1);
+            if ((instruction >> 5) & 0x1) {
+                e.byte(opcode == OP_ADD ? 0x05 : 0x25); // add/and eax, imm32
+                e.imm32(sign_extend_mask(instruction, 5));
+            } else {
+                e.load_register(instruction & 0x7, 1);
+                e.bytes({u8(opcode == OP_ADD ? 0x01 : 0x21), 0xC8}); // add/and eax, ecx
+            }
+            e.store_register(destination);
+            if (flags_live[n]) e.set_flags();
+        } continue;
+
+        case OP_NOT:
+            e.load_register(source1);
+            e.bytes({0xF7, 0xD0}); // not eax
+            e.store_register(destination);
+            if (flags_live[n]) e.set_flags();
+            continue;
+
+        case OP_LEA:
+            e.mov_eax(u16(next + sign_extend_mask(instruction, 9)));
+            e.store_register(destination);
+            if (flags_live[n]) e.set_flags();
+            continue;
+
+        case OP_LD:
+        case OP_LDI:
+            e.mov_eax(u16(next + sign_extend_mask(instruction, 9)));
+            e.load_memory();
+            if (opcode == OP_LDI) {
+                e.check_device(u16(next - 1), n, refunds_end);
+                e.load_memory();
+            }
+            e.store_register(destination);
+            if (flags_live[n]) e.set_flags();
+            continue;
+
+        case OP_LDR:
+            e.load_register(source1);
+            e.byte(0x05); // add eax, imm32
+            e.imm32(sign_extend_mask(instruction, 6));
+            e.zero_extend();
+            e.check_device(u16(next - 1), n, refunds_end);
+            e.load_memory();
+            e.store_register(destination);
+            if (flags_live[n]) e.set_flags();
+            continue;
+
+        case OP_ST:
+        case OP_STI:
+            e.mov_eax(u16(next + sign_extend_mask(instruction, 9)));
+            if (opcode == OP_STI) {
+                e.load_memory();
+                e.check_device(u16(next - 1), n, refunds_end);
+            }
+            e.load_register(destination, 1);
+            e.store_memory(u16(next - 1), n, refunds_end);
+            continue;
+
+        case OP_STR:
+            e.load_register(source1);
+            e.byte(0x05); // add eax, imm32
+            e.imm32(sign_extend_mask(instruction, 6));
+            e.zero_extend();
+            e.check_device(u16(next - 1), n, refunds_end);
+            e.load_register(destination, 1);
+            e.store_memory(u16(next - 1), n, refunds_end);
+            continue;
+
+        case OP_BR: {
+            u16 target = next + sign_extend_mask(instruction, 9);
+            if (destination == 0) {
+                e.exit_direct(next);
+            } else if (destination == (FLAG_NEGATIVE | FLAG_ZERO | FLAG_POSITIVE)) {
+                e.exit_direct(target);
+            } else {
+                e.bytes({0x45, 0x85, 0xED});                   // test r13d, r13d
+                e.bytes({0x0F, branch_condition(destination)}); // jcc taken
+                u8* taken = e.p;
+                e.imm32(0);
+                e.exit_direct(next);
+                patch32(taken, static_cast<std::uint32_t>(e.p - (taken + 4)));
+                e.exit_direct(target);
+            }
+        } break;
+
+        case OP_JSR:
+            if ((instruction >> 11) & 0x1) {
+                e.bytes({0x66, 0xC7, 0x43, 0x0E}); // mov word [rbx + 14], next
+                e.imm16(next);
+                e.exit_direct(next + sign_extend_mask(instruction, 11));
+            } else {
+                e.load_register(source1);
+                e.bytes({0x66, 0xC7, 0x43, 0x0E});
+                e.imm16(next);
+                e.exit_indirect();
+            }
+            break;
+
+        case OP_JMP:
+            e.load_register(source1);
+            e.exit_indirect();
+            break;
+        }
+        ++n;
+        break;
+    }
+
+    patch32(check_length, n);
+    patch32(charge_length, n);
+    for (refund_t* r = refunds; r != refunds_end; ++r)
+        patch32(r->p, n - r->executed);
+    patch32(bail, static_cast<std::uint32_t>(e.p - (bail + 4)));
+    e.mov_eax(static_cast<std::uint32_t>(exit_budget | start));
+    e.jump_epilogue();
+    assert(std::size_t(e.p - cursor) <= max_block_bytes);
+    if (!protect(cursor, e.p, false)) return nullptr;
+
+    void* code = cursor;
+    cursor = e.p;
+    blocks[start] = code;
+    return code;
+}
+
+status_kind jit::run(u64 n)
+{
+    status_kind status = STATUS_RUNNING;
+    if (!buffer) {
+        while (n-- && status == STATUS_RUNNING) status = m.step();
+        return status;
+    }
+
+    u64 native = 0;
+
+    // Hands the machine over to step and back.
+    auto step = [this, &native]() {
+        m.instructions += native;
+        native = 0;
+        m.condition_register = condition_codes_from(frame.flags);
+        status_kind status = m.step();
+        frame.flags = flags_from(m.condition_register);
+        return status;
+    };
+
+    u16 program_counter = m.program_counter;
+    frame.budget = n;
+    frame.flags = flags_from(m.condition_register);
+    while (frame.budget) {
+        void* code = blocks[program_counter];
+        if (!code) code = translate(program_counter);
+        if (!code) {
+            m.program_counter = program_counter;
+            status = step();
+            program_counter = m.program_counter;
+            if (status != STATUS_RUNNING || m.yield) break;
+            --frame.budget;
+            continue;
+        }
+
+        u64 before = frame.budget;
+        u64 result = entry(&frame, code);
+        native += before - frame.budget;
+        program_counter = static_cast<u16>(result);
+        if (result & exit_store) invalidate(static_cast<u16>(result >> 32));
+        if (result & exit_shared) {
+            // Let step copy the page; the store goes straight through next time.
+            m.program_counter = program_counter;
+            status = step();
+            program_counter = m.program_counter;
+            if (status != STATUS_RUNNING || m.yield) break;
+            --frame.budget;
+        }
+        if (result & exit_budget) {
+            // Too few instructions left to enter the block; finish one at a time.
+            m.program_counter = program_counter;
+            while (frame.budget-- && status == STATUS_RUNNING) status = step();
+            program_counter = m.program_counter;
+            break;
+        }
+    }
+    m.program_counter = program_counter;
+    m.condition_register = condition_codes_from(frame.flags);
+    m.instructions += native;
+    return status;
+}
+
+#else
+
+bool jit::available()
+{
+    return false;
+}
+
+jit::jit(machine& m) :
+    m(m)
+{ }
+
+jit::~jit() = default;
+
+void jit::reset() { }
+
+void jit::invalidate(u16) { }
+
+void* jit::translate(u16)
+{
+    return nullptr;
+}
+
+status_kind jit::run(u64 n)
+{
+    status_kind status = STATUS_RUNNING;
+    while (n-- && status == STATUS_RUNNING) status = m.step();
+    return status;
+}
+
+#endif
+
+} // namespace lc3
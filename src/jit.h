@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "machine.h"
+
+namespace lc3 {
+
+// Basic-block translator to x86-64 machine code behind ENGINE_JIT. Only
+// available() on x86-64 targets other than Windows.
+class jit {
+public:
+    static bool available();
+
+    explicit jit(machine& m);
+    ~jit();
+    jit(const jit&) = delete;
+    jit& operator=(const jit&) = delete;
+
+    status_kind run(u64 n);
+
+    // Drops every block that covers address.
+    void invalidate(u16 address);
+
+    // Read by the generated code; the layout is part of the calling convention.
+    struct frame_t {
+        u16* registers;
+        const u16** readable;
+        u64 flags; // the last value that set the condition codes, sign-extended
+        std::uint8_t* translated;
+        void** blocks;
+        u64 budget;
+        u16** writable;
+    };
+
+private:
+    machine& m;
+    frame_t frame;
+    std::uint8_t* buffer = nullptr;
+    std::uint8_t* cursor = nullptr;
+    const std::uint8_t* epilogue = nullptr;
+    u64 (*entry)(frame_t*, const void*) = nullptr;
+    std::unique_ptr<void*[]> blocks;
+    std::unique_ptr<u16[]> block_last;
+    std::unique_ptr<std::uint8_t[]> translated;
+
+    bool protect(std::uint8_t* f, std::uint8_t* l, bool writing);
+    void reset();
+    void* translate(u16 start);
+};
+
+} // namespace lc3
@@ -0,0 +1,474 @@
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include "lanes.h"
+
+namespace lc3 {
+
+using clock = std::chrono::steady_clock;
+
+static inline
+u16 condition_codes(u16 x)
+{
+    if (x == 0) return FLAG_ZERO;
+    if (x >> 15) return FLAG_NEGATIVE;
+    return FLAG_POSITIVE;
+}
+
+// A value whose condition codes are cc.
+static inline
+u16 flag_value(u16 cc)
+{
+    if (cc & FLAG_NEGATIVE) return 0x8000;
+    if (cc & FLAG_ZERO) return 0;
+    return 1;
+}
+
+// A group of up to lane_width machines run together. Everything a lane
+// needs for the instructions run side by side is kept here, one array per
+// register with an element per lane, and only goes back to the machine when
+// the lane steps on its own or stops.
+class lanes {
+public:
+    lanes(machine* const* machines, std::size_t count, const limits_t& limits,
+          status_kind* statuses);
+
+    void run(bool timed, clock::time_point deadline);
+
+private:
+    // How many more instructions than another a lane may have run before
+    // it is given a turn out of order.
+    static const u64 max_lag = u64(1) << 24;
+
+    std::size_t n;
+    machine* m[lane_width];
+    status_kind* statuses;
+
+    u16 r[8][lane_width];
+    u16 values[lane_width]; // the last value to set the condition codes
+    u16 pc[lane_width];
+    // All ones for lanes still in the group, and for those running the
+    // current block.
+    u16 running[lane_width];
+    u16 active[lane_width];
+    // Not counting the instructions of the current block.
+    u64 instructions[lane_width];
+    u64 limit[lane_width];
+    u64 output_left[lane_width];
+    bool solo[lane_width]; // left the group to finish on its own
+
+    // The words any lane may have written to. The machines start out with
+    // the same memory, so elsewhere they all hold the same instruction and
+    // only the leader's needs to be fetched.
+    std::uint64_t written[machine::memory_size / 64];
+
+    void load(std::size_t i);
+    void store(std::size_t i);
+    void stop(std::size_t i, status_kind status);
+    void mark(u16 address) { written[address >> 6] |= std::uint64_t(1) << (address & 63); }
+    bool marked(u16 address) const { return written[address >> 6] >> (address & 63) & 1; }
+    bool pick(std::size_t& leader, u16& next, u64& budget);
+    u64 execute(std::size_t leader, u16 next, u64 budget);
+    void check_code(std::size_t leader, u16 at, u16 instruction, u64 done);
+    void step(std::size_t i, u16 at, u64 done);
+    void leave(u16 at, u64 done);
+    template <typename Value>
+    void set_destination(u16 instruction, Value value);
+};
+
+lanes::lanes(machine* const* machines, std::size_t count, const limits_t& limits,
+             status_kind* statuses) :
+    n(count), statuses(statuses)
+{
+    bool same = true;
+    for (std::size_t i = 0; i != n; ++i) {
+        m[i] = machines[i];
+        load(i);
+        u64 start = m[i]->instructions;
+        limit[i] = start + std::min(limits.instructions, ~start);
+        output_left[i] = limits.output;
+        running[i] = 0xFFFF;
+        active[i] = 0;
+        solo[i] = false;
+        statuses[i] = STATUS_RUNNING;
+        // Interrupts are for run to deliver.
+        if (m[i]->keyboard_status & DEVICE_INTERRUPT_ENABLE) {
+            running[i] = 0;
+            solo[i] = true;
+        }
+        u16 address;
+        if (same && i != 0 && !m[i]->same_memory(*m[0], address)) same = false;
+        // Stores below go straight to memory, past the engines' caches.
+        m[i]->invalidate_all();
+    }
+    std::fill(std::begin(written), std::end(written), same ? 0 : ~std::uint64_t(0));
+}
+
+void lanes::load(std::size_t i)
+{
+    const machine& x = *m[i];
+    for (int j = 0; j != 8; ++j) r[j][i] = x.registers[j];
+    values[i] = flag_value(x.condition_register);
+    pc[i] = x.program_counter;
+    instructions[i] = x.instructions;
+}
+
+void lanes::store(std::size_t i)
+{
+    machine& x = *m[i];
+    for (int j = 0; j != 8; ++j) x.registers[j] = r[j][i];
+    x.condition_register = condition_codes(values[i]);
+    x.program_counter = pc[i];
+    x.instructions = instructions[i];
+}
+
+void lanes::stop(std::size_t i, status_kind status)
+{
+    store(i);
+    running[i] = active[i] = 0;
+    statuses[i] = status;
+}
+
+// Chooses the lanes to run next: those at the lowest program counter that
+// hold the same instruction there, unless a lane has fallen so far behind
+// the rest that it goes first. Sets next to the lowest program counter of
+// the lanes left waiting above, where the block had better stop to pick
+// them up, and budget to the most instructions the block can run.
+bool lanes::pick(std::size_t& leader, u16& next, u64& budget)
+{
+    std::size_t lowest = n;
+    std::size_t laggard = n;
+    u64 most = 0;
+    for (std::size_t i = 0; i != n; ++i) {
+        if (!running[i]) continue;
+        if (instructions[i] == limit[i]) {
+            stop(i, STATUS_INSTRUCTION_LIMIT);
+            continue;
+        }
+        if (lowest == n || pc[i] < pc[lowest]) lowest = i;
+        if (laggard == n || instructions[i] < instructions[laggard]) laggard = i;
+        most = std::max(most, instructions[i]);
+    }
+    if (lowest == n) return false;
+
+    leader = most - instructions[laggard] > max_lag ? laggard : lowest;
+    u16 at = pc[leader];
+    next = 0xFFFF;
+    budget = limit[leader] - instructions[leader];
+    for (std::size_t i = 0; i != n; ++i) {
+        active[i] = 0;
+        if (!running[i]) continue;
+        if (pc[i] == at) {
+            active[i] = 0xFFFF;
+            budget = std::min(budget, limit[i] - instructions[i]);
+        } else if (pc[i] > at) {
+            next = std::min(next, pc[i]);
+        }
+    }
+    if (marked(at)) check_code(leader, at, m[leader]->read(at), 0);
+    return true;
+}
+
+// Drops the lanes that hold something else at at than the leader, as after
+// one of them has stored over its code, done instructions into the block.
+void lanes::check_code(std::size_t leader, u16 at, u16 instruction, u64 done)
+{
+    std::size_t page = at >> machine::page_bits;
+    const u16* code = m[leader]->readable[page];
+    for (std::size_t i = 0; i != n; ++i) {
+        if (!active[i] || m[i]->readable[page] == code || m[i]->read(at) == instruction)
+            continue;
+        active[i] = 0;
+        pc[i] = at;
+        instructions[i] += done;
+    }
+}
+
+// Runs the instruction at at for lane i alone, with the reference
+// interpreter, and takes it out of the block after done instructions.
+void lanes::step(std::size_t i, u16 at, u64 done)
+{
+    machine& x = *m[i];
+    pc[i] = at;
+    instructions[i] += done;
+    store(i);
+    x.output_left = output_left[i];
+    status_kind status = x.step();
+    output_left[i] = x.output_left;
+    x.output_left = std::numeric_limits<u64>::max();
+    load(i);
+    active[i] = 0;
+    if (status != STATUS_RUNNING) {
+        stop(i, status);
+    } else if (x.keyboard_status & DEVICE_INTERRUPT_ENABLE) {
+        running[i] = 0;
+        solo[i] = true;
+    }
+}
+
+// Ends the block with the lanes still in it at at, done instructions on.
+void lanes::leave(u16 at, u64 done)
+{
+    for (std::size_t i = 0; i != n; ++i) {
+        if (active[i]) {
+            pc[i] = at;
+            instructions[i] += done;
+        }
+        active[i] = 0;
+    }
+}
+
+// Sets the destination register of the active lanes to value(i), and their
+// condition codes with it.
+template <typename Value>
+void lanes::set_destination(u16 instruction, Value value)
+{
+    u16 x[lane_width];
+    for (std::size_t i = 0; i != n; ++i) x[i] = value(i);
+    u16* d = r[(instruction >> 9) & 0x7];
+    for (std::size_t i = 0; i != n; ++i) {
+        u16 keep = static_cast<u16>(~active[i]);
+        d[i] = (d[i] & keep) | (x[i] & active[i]);
+        values[i] = (values[i] & keep) | (x[i] & active[i]);
+    }
+}
+
+// Runs the active lanes from the leader's program counter for as long as
+// they go the same way, up to budget instructions. Returns the number of
+// instructions run.
+u64 lanes::execute(std::size_t leader, u16 next, u64 budget)
+{
+    const machine& lead = *m[leader];
+    u16 at = pc[leader];
+    u64 done = 0;
+    while (done != budget) {
+        if (done != 0 && at >= next) break;
+        u16 instruction = lead.read(at);
+        if (done != 0 && marked(at)) check_code(leader, at, instruction, done);
+        u16 following = at + 1;
+        const u16* a = r[(instruction >> 6) & 0x7];
+        const u16* b = r[instruction & 0x7];
+        const u16* source = r[(instruction >> 9) & 0x7];
+
+        switch (instruction >> 12) {
+        case OP_ADD: {
+            if ((instruction >> 5) & 0x1) {
+                u16 immediate = sign_extend_mask(instruction, 5);
+                set_destination(instruction, [a, immediate](std::size_t i) { return u16(a[i] + immediate); });
+            } else {
+                set_destination(instruction, [a, b](std::size_t i) { return u16(a[i] + b[i]); });
+            }
+        } break;
+
+        case OP_AND: {
+            if ((instruction >> 5) & 0x1) {
+                u16 immediate = sign_extend_mask(instruction, 5);
+                set_destination(instruction, [a, immediate](std::size_t i) { return u16(a[i] & immediate); });
+            } else {
+                set_destination(instruction, [a, b](std::size_t i) { return u16(a[i] & b[i]); });
+            }
+        } break;
+
+        case OP_NOT: {
+            set_destination(instruction, [a](std::size_t i) { return u16(~a[i]); });
+        } break;
+
+        case OP_LEA: {
+            u16 address = following + sign_extend_mask(instruction, 9);
+            set_destination(instruction, [address](std::size_t) { return address; });
+        } break;
+
+        case OP_BR: {
+            u16 nzp = (instruction >> 9) & 0x7;
+            u16 target = following + sign_extend_mask(instruction, 9);
+            u16 taken[lane_width];
+            u16 any = 0;
+            u16 all = 0xFFFF;
+            for (std::size_t i = 0; i != n; ++i) {
+                u16 v = values[i];
+                u16 cc = v == 0 ? FLAG_ZERO : v >> 15 ? FLAG_NEGATIVE : FLAG_POSITIVE;
+                u16 t = (cc & nzp) ? 0xFFFF : 0;
+                taken[i] = t & active[i];
+                any |= taken[i];
+                all &= t | static_cast<u16>(~active[i]);
+            }
+            ++done;
+            if (!any) {
+                at = following;
+                continue;
+            }
+            if (all) {
+                at = target;
+                continue;
+            }
+            for (std::size_t i = 0; i != n; ++i) {
+                if (active[i]) {
+                    pc[i] = taken[i] ? target : following;
+                    instructions[i] += done;
+                }
+                active[i] = 0;
+            }
+            return done;
+        }
+
+        case OP_JMP:
+        case OP_JSR: {
+            bool relative = (instruction >> 12) == OP_JSR && ((instruction >> 11) & 0x1);
+            u16 targets[lane_width];
+            std::copy(a, a + lane_width, targets);
+            if ((instruction >> 12) == OP_JSR) {
+                u16* link = r[7];
+                for (std::size_t i = 0; i != n; ++i)
+                    link[i] = (link[i] & static_cast<u16>(~active[i])) | (following & active[i]);
+            }
+            ++done;
+            if (relative) {
+                at = following + sign_extend_mask(instruction, 11);
+                continue;
+            }
+            u16 target = targets[leader];
+            u16 differ = 0;
+            for (std::size_t i = 0; i != n; ++i) differ |= (targets[i] ^ target) & active[i];
+            if (!differ) {
+                at = target;
+                continue;
+            }
+            for (std::size_t i = 0; i != n; ++i) {
+                if (active[i]) {
+                    pc[i] = targets[i];
+                    instructions[i] += done;
+                }
+                active[i] = 0;
+            }
+            return done;
+        }
+
+        // Every lane has memory of its own, so loads and stores are carried
+        // out a lane at a time, and those reaching the device registers on
+        // step.
+        case OP_LD:
+        case OP_LDR:
+        case OP_LDI: {
+            u16 op = instruction >> 12;
+            u16 offset = op == OP_LDR ? sign_extend_mask(instruction, 6)
+                                      : u16(following + sign_extend_mask(instruction, 9));
+            u16* d = r[(instruction >> 9) & 0x7];
+            bool alone = false;
+            for (std::size_t i = 0; i != n; ++i) {
+                if (!active[i]) continue;
+                const machine& x = *m[i];
+                u16 address = op == OP_LDR ? u16(a[i] + offset) : offset;
+                if (op == OP_LDI && address < DEVICE_BASE) address = x.read(address);
+                if (address >= DEVICE_BASE) {
+                    step(i, at, done);
+                    alone = true;
+                    continue;
+                }
+                d[i] = values[i] = x.read(address);
+            }
+            if (alone) {
+                leave(following, done + 1);
+                return done + 1;
+            }
+        } break;
+
+        case OP_ST:
+        case OP_STR:
+        case OP_STI: {
+            u16 op = instruction >> 12;
+            u16 offset = op == OP_STR ? sign_extend_mask(instruction, 6)
+                                      : u16(following + sign_extend_mask(instruction, 9));
+            bool alone = false;
+            for (std::size_t i = 0; i != n; ++i) {
+                if (!active[i]) continue;
+                machine& x = *m[i];
+                u16 address = op == OP_STR ? u16(a[i] + offset) : offset;
+                if (op == OP_STI && address < DEVICE_BASE) address = x.read(address);
+                mark(address);
+                if (address >= DEVICE_BASE) {
+                    step(i, at, done);
+                    alone = true;
+                    continue;
+                }
+                x.store(address, source[i]);
+            }
+            if (alone) {
+                leave(following, done + 1);
+                return done + 1;
+            }
+        } break;
+
+        // TRAP, RTI and the invalid opcode. Exceptions push the processor
+        // status and program counter on the supervisor stack.
+        default: {
+            for (std::size_t i = 0; i != n; ++i) {
+                if (!active[i]) continue;
+                step(i, at, done);
+                mark(r[6][i]);
+                mark(r[6][i] + 1);
+            }
+            return done + 1;
+        }
+        }
+        ++done;
+        at = following;
+    }
+    leave(at, done);
+    return done;
+}
+
+void lanes::run(bool timed, clock::time_point deadline)
+{
+    // Instructions between looks at the clock.
+    const u64 slice = u64(1) << 20;
+
+    u64 since = 0;
+    std::size_t leader;
+    u16 next;
+    u64 budget;
+    while (pick(leader, next, budget)) {
+        since += execute(leader, next, std::min(budget, slice));
+        if (timed && since >= slice) {
+            since = 0;
+            if (clock::now() >= deadline) break;
+        }
+    }
+    for (std::size_t i = 0; i != n; ++i) {
+        if (running[i]) stop(i, STATUS_TIME_LIMIT);
+    }
+
+    for (std::size_t i = 0; i != n; ++i) {
+        if (!solo[i]) continue;
+        limits_t rest;
+        rest.instructions = limit[i] - instructions[i];
+        rest.output = output_left[i];
+        if (timed) {
+            clock::time_point now = clock::now();
+            if (now >= deadline) {
+                statuses[i] = STATUS_TIME_LIMIT;
+                continue;
+            }
+            rest.seconds = std::chrono::duration<double>(deadline - now).count();
+        }
+        statuses[i] = m[i]->run(rest);
+    }
+}
+
+void run_lanes(machine* const* machines, std::size_t count, const limits_t& limits,
+               status_kind* statuses)
+{
+    bool timed = limits.seconds < std::numeric_limits<double>::infinity();
+    clock::time_point deadline;
+    if (timed)
+        deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(std::max(limits.seconds, 0.0)));
+
+    for (std::size_t first = 0; first < count; first += lane_width) {
+        std::unique_ptr<lanes> group(new lanes(machines + first,
+                                               std::min(count - first, lane_width),
+                                               limits, statuses + first));
+        group->run(timed, deadline);
+    }
+}
+
+} // namespace lc3
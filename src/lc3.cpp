@@ -1,218 +1,252 @@
 #define _CRT_SECURE_NO_WARNINGS
-#include <cstdint>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
-#include <cstdio>
-#include <fstream>
-#include <iterator>
-#include <limits>
-#include "endian.h"
-
-using u16 = std::uint16_t;
-
-enum {
-    OP_BR,
-    OP_ADD,
-    OP_LD,
-    OP_ST,
-    OP_JSR,
-    OP_AND,
-    OP_LDR,
-    OP_STR,
-    OP_RTI,
-    OP_NOT,
-    OP_LDI,
-    OP_STI,
-    OP_JMP,
-    OP_INVALID,
-    OP_LEA,
-    OP_TRAP,
-};
-
-enum {
-    TRAP_GETC = 0x20,
-    TRAP_OUT  = 0x21,
-    TRAP_PUTS = 0x22,
-    TRAP_IN   = 0x23,
-    TRAP_HALT = 0x25,
-};
-
-static u16 registers[8];
-
-static inline
-u16& get_register(u16 x, int n)
-{ return registers[(x >> n) & 0x7]; }
-
-static u16 condition_register;
-static u16 memory[std::numeric_limits<u16>::max()];
-
-u16 sign_extend(u16 x, int n)
+#include <memory>
+#include <string>
+#include <thread>
+#include "machine.h"
+#include "jit.h"
+#include "memory_profile.h"
+#include "profile.h"
+#include "trace.h"
+#include "lockstep.h"
+#include "batch.h"
+
+// The listing lc3al writes next to object_filename.
+static
+std::string listing_filename(const char* object_filename)
 {
-    if ((x >> (n - 1)) & 1) x |= (0xFFFF << n);
-    return x;
+    std::string name(object_filename);
+    std::size_t dot = name.find_last_of("./\\");
+    if (dot != std::string::npos && name[dot] == '.') name.erase(dot + 1);
+    else name += '.';
+    return name + "lst";
 }
 
-u16 sign_extend_mask(u16 x, int n)
-{
-    u16 mask = 0xFFFF >> (16 - n);
-    return sign_extend(x & mask, n);
-}
+// Exit statuses for programs stopped before they halted.
+static const int exit_instruction_limit = 3;
+static const int exit_time_limit = 4;
+static const int exit_output_limit = 5;
+static const int exit_end_of_input = 6;
+static const int exit_diverged = 7;
 
-enum {
-    FLAG_POSITIVE = 1 << 0,
-    FLAG_ZERO = 1 << 1,
-    FLAG_NEGATIVE = 1 << 2,
-};
+// How often --lockstep compares the engines by default.
+static const lc3::u64 default_lockstep_interval = 1000;
 
-void set_condition_codes(u16 x)
+static
+int usage()
 {
-    if (x == 0) condition_register = FLAG_ZERO;
-    else if (x >> 15) condition_register = FLAG_NEGATIVE;
-    else condition_register = FLAG_POSITIVE;
+    fputs("Usage: lc3 [--engine=interp|jit|step] [limits] [--profile report]\n"
+          "           [--heatmap report] [--trace=file] [--replay=file] [os] objectfile\n"
+          "       lc3 [--engine=interp|jit] [limits] --lockstep[=n] [os] objectfile\n"
+          "       lc3 [--engine=interp|jit|step] [limits] --batch manifest [-j threads]\n"
+          "           [--lanes]\n"
+          "Limits: [--timeout seconds] [--max-instructions n] [--max-output bytes]\n"
+          "OS: --os objectfile [--interpret-os]\n",
+          stderr);
+    return EXIT_FAILURE;
 }
 
 int main(int argc, char** argv)
 {
-    if (argc != 2) {
-        fputs("Usage: lc3 objectfile", stderr);
+    lc3::engine_kind engine = lc3::ENGINE_INTERP;
+    const char* object_filename = nullptr;
+    const char* manifest_filename = nullptr;
+    const char* profile_filename = nullptr;
+    const char* heatmap_filename = nullptr;
+    const char* trace_filename = nullptr;
+    const char* replay_filename = nullptr;
+    const char* os_filename = nullptr;
+    bool interpret_os = false;
+    lc3::u64 lockstep_interval = 0;
+    unsigned threads = std::thread::hardware_concurrency();
+    lc3::limits_t limits;
+    bool timeout_given = false;
+    bool lanes = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--engine=", 9) == 0) {
+            if (strcmp(arg + 9, "jit") == 0) engine = lc3::ENGINE_JIT;
+            else if (strcmp(arg + 9, "interp") == 0) engine = lc3::ENGINE_INTERP;
+            else if (strcmp(arg + 9, "step") == 0) engine = lc3::ENGINE_STEP;
+            else {
+                fprintf(stderr, "lc3: error: unknown engine '%s'\n", arg + 9);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(arg, "--batch") == 0 && i + 1 < argc) {
+            manifest_filename = argv[++i];
+        } else if (strcmp(arg, "--profile") == 0 && i + 1 < argc) {
+            profile_filename = argv[++i];
+        } else if (strcmp(arg, "--heatmap") == 0 && i + 1 < argc) {
+            heatmap_filename = argv[++i];
+        } else if (strcmp(arg, "--os") == 0 && i + 1 < argc) {
+            os_filename = argv[++i];
+        } else if (strcmp(arg, "--interpret-os") == 0) {
+            interpret_os = true;
+        } else if (strncmp(arg, "--trace=", 8) == 0) {
+            trace_filename = arg + 8;
+        } else if (strncmp(arg, "--replay=", 9) == 0) {
+            replay_filename = arg + 9;
+        } else if (strcmp(arg, "--lockstep") == 0) {
+            lockstep_interval = default_lockstep_interval;
+        } else if (strncmp(arg, "--lockstep=", 11) == 0) {
+            lockstep_interval = strtoull(arg + 11, nullptr, 10);
+            if (lockstep_interval == 0) return usage();
+        } else if (strcmp(arg, "--lanes") == 0) {
+            lanes = true;
+        } else if (strcmp(arg, "-j") == 0 && i + 1 < argc) {
+            threads = static_cast<unsigned>(atoi(argv[++i]));
+        } else if (strcmp(arg, "--timeout") == 0 && i + 1 < argc) {
+            limits.seconds = atof(argv[++i]);
+            timeout_given = true;
+        } else if (strcmp(arg, "--max-instructions") == 0 && i + 1 < argc) {
+            limits.instructions = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(arg, "--max-output") == 0 && i + 1 < argc) {
+            limits.output = strtoull(argv[++i], nullptr, 10);
+        } else if (arg[0] != '-' && !object_filename) {
+            object_filename = arg;
+        } else {
+            return usage();
+        }
+    }
+    if (!object_filename == !manifest_filename) return usage();
+    if ((profile_filename || heatmap_filename || trace_filename || replay_filename
+         || lockstep_interval || os_filename) && manifest_filename)
+        return usage();
+    if (interpret_os && !os_filename) return usage();
+    if (lockstep_interval && (profile_filename || heatmap_filename || trace_filename))
+        return usage();
+    if (lanes && !manifest_filename) return usage();
+    if (engine == lc3::ENGINE_JIT && !lc3::jit::available()) {
+        fputs("lc3: error: the jit engine is not supported on this platform\n", stderr);
         return EXIT_FAILURE;
     }
 
-    const char* object_filename = argv[1];
-    std::ifstream object_file(object_filename, std::ios::binary);
-    if (!object_file) {
-        fprintf(stderr, "lc3: error: %s\n", strerror(errno));
-        return EXIT_FAILURE;
+    if (manifest_filename) {
+        if (!timeout_given) limits.seconds = 10;
+        return run_batch(manifest_filename, threads, limits, engine, lanes);
     }
 
-    std::istream_iterator<unsigned char> f_i(object_file);
-    std::istream_iterator<unsigned char> l_i{};
-    u16 program_counter;
-    f_i = rks::load_big_endian(program_counter, f_i);
-    u16* memory_cursor = memory + program_counter;
-    while (f_i != l_i) {
-        f_i = rks::load_big_endian(*memory_cursor, f_i);
-        ++memory_cursor;
+    lc3::stdio_console io(true);
+    lc3::machine machine;
+    machine.engine = engine;
+    machine.io = &io;
+    // The program is loaded over the operating system, and starts at its
+    // own entry.
+    if (os_filename) {
+        if (!machine.load(os_filename)) {
+            fprintf(stderr, "lc3: error: %s: %s\n", os_filename, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        machine.os = interpret_os ? lc3::OS_GUEST : lc3::OS_ACCELERATED;
+    }
+    if (!machine.load(object_filename)) {
+        fprintf(stderr, "lc3: error: %s: %s\n", object_filename, strerror(errno));
+        return EXIT_FAILURE;
     }
 
-    bool running = true;
-    while (running) {
-        u16 instruction = memory[program_counter++];
-        u16 opcode = instruction >> 12;
-        switch (opcode) {
-        case OP_BR: {
-            if (((instruction >> 9) & 0x7) & condition_register)
-                program_counter += sign_extend_mask(instruction, 9);
-        } break;
-
-        case OP_ADD: {
-            u16& destination = get_register(instruction, 9);
-            u16 source1 = get_register(instruction, 6);
-            if ((instruction >> 5u) & 0x1)
-                destination = source1 + sign_extend_mask(instruction, 5);
-            else
-                destination = source1 + get_register(instruction, 0);
-            set_condition_codes(destination);
-        } break;
-
-        case OP_LD: {
-            u16& destination = get_register(instruction, 9);
-            destination = memory[program_counter + sign_extend_mask(instruction, 9)];
-            set_condition_codes(destination);
-        } break;
-
-        case OP_ST: {
-            memory[program_counter + sign_extend_mask(instruction, 9)] = get_register(instruction, 9);
-        } break;
-
-        case OP_JSR: {
-            registers[7] = program_counter;
-            if ((instruction >> 11) & 0x1)
-                program_counter += sign_extend_mask(instruction, 11);
-            else
-                program_counter = get_register(instruction, 6);
-        } break;
-
-        case OP_AND: {
-            u16& destination = get_register(instruction, 9);
-            u16 source1 = get_register(instruction, 6);
-            if ((instruction >> 5u) & 0x1)
-                destination = source1 & sign_extend_mask(instruction, 5);
-            else
-                destination = source1 & get_register(instruction, 0);
-            set_condition_codes(destination);
-        } break;
-
-        case OP_LDR: {
-            u16& destination = get_register(instruction, 9);
-            destination = memory[get_register(instruction, 6) + sign_extend_mask(instruction, 6)];
-            set_condition_codes(destination);
-        } break;
-
-        case OP_STR: {
-            memory[get_register(instruction, 6) + sign_extend_mask(instruction, 6)] = get_register(instruction, 9);
-        } break;
-
-        case OP_NOT: {
-            u16& destination = get_register(instruction, 9);
-            destination = ~get_register(instruction, 6);
-            set_condition_codes(destination);
-        } break;
-
-        case OP_LDI: {
-            u16& destination = get_register(instruction, 9);
-            destination = memory[memory[program_counter + sign_extend_mask(instruction, 9)]];
-            set_condition_codes(destination);
-        } break;
-
-        case OP_STI: {
-            memory[memory[program_counter + sign_extend_mask(instruction, 9)]] = get_register(instruction, 9);
-        } break;
-
-        case OP_JMP: {
-            program_counter = get_register(instruction, 6);
-        } break;
-
-        case OP_LEA: {
-            u16& destination = get_register(instruction, 9);
-            destination = program_counter + sign_extend_mask(instruction, 9);
-            set_condition_codes(destination);
-        } break;
-
-        case OP_TRAP: {
-            switch (instruction & 0xFF) {
-            case TRAP_GETC: {
-                int c = getchar();
-                registers[0] = static_cast<u16>(c);
-            } break;
-            case TRAP_OUT: {
-                putchar(registers[0]);
-            } break;
-            case TRAP_PUTS: {
-                u16* s = memory + registers[0];
-                while (*s) {
-                    putchar(*s);
-                    ++s;
-                }
-            } break;
-            case TRAP_IN: {
-                puts("Enter the character: ");
-                unsigned char c = getchar();
-                putchar(c);
-                registers[0] = static_cast<u16>(c);
-            } break;
-            case TRAP_HALT: {
-                puts("\nprogram finished");
-                fflush(stdout);
-                running = false;
-            } break;
-            }
-        } break;
+    // Replaying takes the input from the old trace; tracing records whatever
+    // the program ends up reading.
+    lc3::trace_reader replay;
+    std::unique_ptr<lc3::replay_console> replay_io;
+    if (replay_filename) {
+        if (!replay.open(replay_filename)) {
+            fprintf(stderr, "lc3: error: %s: %s\n", replay_filename,
+                    errno == EINVAL ? "not a trace" : strerror(errno));
+            return EXIT_FAILURE;
+        }
+        replay_io.reset(new lc3::replay_console(replay, io, machine));
+        machine.io = replay_io.get();
+    }
 
-        case OP_RTI:
-        case OP_INVALID:
-            fputs("invalid operation: terminating", stderr);
-            std::exit(EXIT_FAILURE);
+    std::unique_ptr<lc3::trace_writer> trace;
+    std::unique_ptr<lc3::recording_console> recording_io;
+    if (trace_filename) {
+        trace.reset(new lc3::trace_writer);
+        if (!trace->open(trace_filename)) {
+            fprintf(stderr, "lc3: error: %s: %s\n", trace_filename, strerror(errno));
+            return EXIT_FAILURE;
         }
+        recording_io.reset(new lc3::recording_console(*machine.io, *trace, machine));
+        machine.io = recording_io.get();
+        machine.tracer = trace.get();
+    }
+
+    std::unique_ptr<lc3::profile> profile;
+    if (profile_filename) {
+        profile.reset(new lc3::profile);
+        machine.profiler = profile.get();
+    }
+
+    std::unique_ptr<lc3::memory_profile> heatmap;
+    if (heatmap_filename) {
+        heatmap.reset(new lc3::memory_profile(machine));
+        machine.memory_profiler = heatmap.get();
+    }
+
+    lc3::status_kind status;
+    lc3::divergence_t divergence;
+    if (lockstep_interval) {
+        // The candidate starts from the same image and runs the selected
+        // engine against step.
+        lc3::machine candidate(machine.save());
+        candidate.engine = engine;
+        candidate.os = machine.os;
+        machine.engine = lc3::ENGINE_STEP;
+        status = lc3::run_lockstep(machine, candidate, limits, lockstep_interval, divergence);
+    } else {
+        status = machine.run(limits);
+    }
+
+    if (profile && !profile->write_report(profile_filename, machine,
+                                          listing_filename(object_filename).c_str())) {
+        io.flush();
+        fprintf(stderr, "lc3: error: %s: %s\n", profile_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (heatmap && !heatmap->write_report(heatmap_filename)) {
+        io.flush();
+        fprintf(stderr, "lc3: error: %s: %s\n", heatmap_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (trace && !trace->close()) {
+        io.flush();
+        fprintf(stderr, "lc3: error: %s: %s\n", trace_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    io.flush();
+    if (divergence.found) {
+        fprintf(stderr, "lc3: the engines diverged between instructions %llu and %llu:\n"
+                        "%-12s step   %s\n%s",
+                static_cast<unsigned long long>(divergence.first),
+                static_cast<unsigned long long>(divergence.last),
+                "", engine == lc3::ENGINE_JIT ? "jit" : engine == lc3::ENGINE_STEP ? "step" : "interp",
+                divergence.differences.c_str());
+        return exit_diverged;
+    }
+    switch (status) {
+    case lc3::STATUS_INVALID:
+        fputs("invalid operation: terminating", stderr);
+        return EXIT_FAILURE;
+    case lc3::STATUS_INSTRUCTION_LIMIT:
+        fputs("lc3: instruction limit reached\n", stderr);
+        return exit_instruction_limit;
+    case lc3::STATUS_TIME_LIMIT:
+        fputs("lc3: time limit reached\n", stderr);
+        return exit_time_limit;
+    case lc3::STATUS_OUTPUT_LIMIT:
+        fputs("lc3: output limit reached\n", stderr);
+        return exit_output_limit;
+    case lc3::STATUS_END_OF_INPUT:
+        fputs("lc3: the program read past the end of input\n", stderr);
+        return exit_end_of_input;
+    default:
+        return EXIT_SUCCESS;
     }
 }
@@ -0,0 +1,479 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "byte_order.h"
+#include "mapped_file.h"
+#include "machine.h"
+
+using lc3::u16;
+
+static const std::size_t memory_size = lc3::machine::memory_size;
+
+static
+int usage()
+{
+    fputs("Usage: lc3aot objectfile [-o outputfile]\n", stderr);
+    return EXIT_FAILURE;
+}
+
+// Memory as the object file leaves it.
+struct image_t {
+    std::vector<u16> words = std::vector<u16>(memory_size);
+    std::vector<bool> loaded = std::vector<bool>(memory_size);
+    u16 entry = 0;
+};
+
+static
+bool load_segment(image_t& image, u16 origin, const unsigned char* f, std::size_t count)
+{
+    if (origin + count > memory_size) return false;
+    for (std::size_t i = 0; i != count; ++i) {
+        f = rks::load_big_endian(image.words[origin + i], f);
+        image.loaded[origin + i] = true;
+    }
+    return true;
+}
+
+// Reads a plain or segmented object file, as lc3::machine::load does.
+static
+bool read_object(const unsigned char* f, const unsigned char* l, bool segmented, image_t& image)
+{
+    static const unsigned char magic[4] = { 'L', 'C', '3', 'S' };
+    if (segmented) {
+        if (l - f < 6 || !std::equal(magic, magic + 4, f)) return false;
+        f = rks::load_big_endian(image.entry, f + 4);
+        while (f != l) {
+            if (l - f < 4) return false;
+            u16 origin, count;
+            f = rks::load_big_endian(origin, f);
+            f = rks::load_big_endian(count, f);
+            if (std::size_t(l - f) / 2 < count || !load_segment(image, origin, f, count))
+                return false;
+            f += 2 * std::size_t(count);
+        }
+        return true;
+    }
+    if (l - f < 2 || (l - f) % 2 != 0) return false;
+    f = rks::load_big_endian(image.entry, f);
+    return load_segment(image, image.entry, f, std::size_t(l - f) / 2);
+}
+
+// What becomes of each word of memory.
+enum word_kind {
+    WORD_DATA,     // never reached
+    WORD_COMPILED, // translated into C++
+    WORD_STEPPED,  // reached, but left to step
+};
+
+// Every instruction reachable from the entry point, and which of them start
+// a block.
+struct program_t {
+    std::vector<word_kind> kinds = std::vector<word_kind>(memory_size, WORD_DATA);
+    std::vector<bool> leaders = std::vector<bool>(memory_size);
+};
+
+static
+u16 opcode(u16 instruction)
+{
+    return instruction >> 12;
+}
+
+static
+u16 pc_relative(u16 address, u16 instruction, int bits)
+{
+    return static_cast<u16>(address + 1 + lc3::sign_extend_mask(instruction, bits));
+}
+
+// TRAPs, RTI, the invalid opcode and fixed device registers are left to step.
+static
+bool stepped(u16 address, u16 instruction)
+{
+    switch (opcode(instruction)) {
+    case lc3::OP_TRAP:
+    case lc3::OP_RTI:
+    case lc3::OP_INVALID:
+        return true;
+    case lc3::OP_LD:
+    case lc3::OP_ST:
+    case lc3::OP_LDI:
+    case lc3::OP_STI:
+        return pc_relative(address, instruction, 9) >= lc3::DEVICE_BASE;
+    }
+    return false;
+}
+
+// Follows every path from the entry point through the loaded words. Jumps
+// through a register lead wherever they lead at run time.
+static
+void explore(const image_t& image, program_t& program)
+{
+    std::vector<u16> work{image.entry};
+    program.leaders[image.entry] = true;
+    auto branch = [&work, &program](u16 target) {
+        program.leaders[target] = true;
+        work.push_back(target);
+    };
+
+    while (!work.empty()) {
+        u16 address = work.back();
+        work.pop_back();
+        if (program.kinds[address] != WORD_DATA) continue;
+        if (!image.loaded[address] || address >= lc3::DEVICE_BASE) {
+            program.kinds[address] = WORD_STEPPED;
+            continue;
+        }
+
+        u16 instruction = image.words[address];
+        u16 next = address + 1;
+        if (stepped(address, instruction)) {
+            program.kinds[address] = WORD_STEPPED;
+            if (instruction != (lc3::OP_TRAP << 12 | lc3::TRAP_HALT)
+                && opcode(instruction) != lc3::OP_RTI && opcode(instruction) != lc3::OP_INVALID)
+                branch(next);
+            continue;
+        }
+
+        program.kinds[address] = WORD_COMPILED;
+        switch (opcode(instruction)) {
+        case lc3::OP_BR: {
+            u16 nzp = (instruction >> 9) & 0x7;
+            if (nzp != 0) branch(pc_relative(address, instruction, 9));
+            if (nzp == 0x7) break;
+            if (nzp != 0) branch(next);
+            else work.push_back(next);
+        } break;
+        case lc3::OP_JSR:
+            if ((instruction >> 11) & 0x1) branch(pc_relative(address, instruction, 11));
+            branch(next);
+            break;
+        case lc3::OP_JMP:
+            break;
+        default:
+            work.push_back(next);
+            break;
+        }
+    }
+}
+
+// Whether the instruction is the last in its block.
+static
+bool ends_block(u16 instruction)
+{
+    switch (opcode(instruction)) {
+    case lc3::OP_BR:
+        return ((instruction >> 9) & 0x7) != 0;
+    case lc3::OP_JSR:
+    case lc3::OP_JMP:
+        return true;
+    }
+    return false;
+}
+
+static
+std::string hex(u16 x)
+{
+    char s[8];
+    snprintf(s, sizeof(s), "0x%04X", x);
+    return s;
+}
+
+static
+std::string label(u16 address)
+{
+    char s[8];
+    snprintf(s, sizeof(s), "x%04X", address);
+    return s;
+}
+
+static
+std::string reg(u16 instruction, int shift)
+{
+    return "r" + std::to_string((instruction >> shift) & 0x7);
+}
+
+// rN plus a sign-extended offset, wrapped to 16 bits.
+static
+std::string offset(const std::string& base, u16 x)
+{
+    int n = static_cast<std::int16_t>(x);
+    if (n == 0) return base;
+    return "u16(" + base + (n < 0 ? " - " : " + ") + std::to_string(n < 0 ? -n : n) + ")";
+}
+
+// The C++ condition for a BR with these nzp bits; flags holds the last value
+// that set the condition codes.
+static
+const char* condition(u16 nzp)
+{
+    static const char* const conditions[8] = {
+        "false",
+        "u16(flags - 1) < 0x7FFF",
+        "flags == 0",
+        "!(flags & 0x8000)",
+        "(flags & 0x8000)",
+        "flags != 0",
+        "u16(flags - 1) >= 0x7FFF",
+        "true",
+    };
+    return conditions[nzp];
+}
+
+static const char* const mnemonics[16] = {
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "reserved", "LEA", "TRAP",
+};
+
+class translator {
+public:
+    translator(const image_t& image, const program_t& program, FILE* out) :
+        image(image), program(program), out(out)
+    { }
+
+    void translate(const char* object_filename, const unsigned char* f, std::size_t n);
+
+private:
+    const image_t& image;
+    const program_t& program;
+    FILE* out;
+    std::vector<bool> stubs = std::vector<bool>(memory_size);
+
+    void emit_block(u16 leader);
+    void emit_instruction(u16 address, u16 instruction, std::size_t left);
+    std::string go(u16 target);
+};
+
+// Jumps to the block at target, or to a stub that leaves it to step.
+std::string translator::go(u16 target)
+{
+    if (!program.leaders[target] || program.kinds[target] != WORD_COMPILED) stubs[target] = true;
+    return "goto " + label(target) + ";";
+}
+
+void translator::emit_block(u16 leader)
+{
+    std::size_t count = 0;
+    u16 address = leader;
+    do {
+        ++count;
+    } while (!ends_block(image.words[address++]) && program.kinds[address] == WORD_COMPILED
+             && !program.leaders[address]);
+
+    fprintf(out, "%s:\n", label(leader).c_str());
+    fprintf(out, "    if (left < %zu) {\n        pc = %s;\n        goto out;\n    }\n",
+            count, hex(leader).c_str());
+    fprintf(out, "    left -= %zu;\n", count);
+    address = leader;
+    for (std::size_t i = 0; i != count; ++i, ++address)
+        emit_instruction(address, image.words[address], count - i);
+    if (!ends_block(image.words[address - 1])) fprintf(out, "    %s\n", go(address).c_str());
+}
+
+// Writes out one instruction, with left instructions of the block still
+// charged to the budget counting this one.
+void translator::emit_instruction(u16 address, u16 instruction, std::size_t left)
+{
+    u16 next = address + 1;
+    std::string before = "{\n            pc = " + hex(address) + ";\n            left += "
+        + std::to_string(left) + ";\n            goto out;\n        }";
+    std::string after = "{\n            pc = " + hex(next) + ";\n            left += "
+        + std::to_string(left - 1) + ";\n            goto out;\n        }";
+    std::string d = reg(instruction, 9);
+    std::string a = reg(instruction, 6);
+    bool immediate = (instruction >> 5) & 0x1;
+
+    fprintf(out, "    // %s %s\n", label(address).c_str(), mnemonics[opcode(instruction)]);
+    switch (opcode(instruction)) {
+    case lc3::OP_ADD:
+    case lc3::OP_AND: {
+        std::string value;
+        if (opcode(instruction) == lc3::OP_ADD)
+            value = immediate ? offset(a, lc3::sign_extend_mask(instruction, 5))
+                              : "u16(" + a + " + " + reg(instruction, 0) + ")";
+        else
+            value = "u16(" + a + " & "
+                + (immediate ? hex(lc3::sign_extend_mask(instruction, 5)) : reg(instruction, 0)) + ")";
+        fprintf(out, "    flags = %s = %s;\n", d.c_str(), value.c_str());
+    } break;
+
+    case lc3::OP_NOT:
+        fprintf(out, "    flags = %s = u16(~%s);\n", d.c_str(), a.c_str());
+        break;
+
+    case lc3::OP_LEA:
+        fprintf(out, "    flags = %s = %s;\n", d.c_str(),
+                hex(pc_relative(address, instruction, 9)).c_str());
+        break;
+
+    case lc3::OP_LD:
+        fprintf(out, "    flags = %s = m.read(%s);\n", d.c_str(),
+                hex(pc_relative(address, instruction, 9)).c_str());
+        break;
+
+    case lc3::OP_LDR:
+    case lc3::OP_LDI: {
+        std::string source = opcode(instruction) == lc3::OP_LDR
+            ? offset(a, lc3::sign_extend_mask(instruction, 6))
+            : "m.read(" + hex(pc_relative(address, instruction, 9)) + ")";
+        fprintf(out, "    {\n        u16 a = %s;\n        if (a >= 0xFE00) %s\n"
+                     "        flags = %s = m.read(a);\n    }\n",
+                source.c_str(), before.c_str(), d.c_str());
+    } break;
+
+    case lc3::OP_ST: {
+        u16 target = pc_relative(address, instruction, 9);
+        fprintf(out, "    m.write(%s, %s);\n", hex(target).c_str(), d.c_str());
+        if (program.kinds[target] == WORD_COMPILED)
+            fprintf(out, "    if (!m.translation) %s\n", after.c_str());
+    } break;
+
+    case lc3::OP_STR:
+    case lc3::OP_STI: {
+        std::string target = opcode(instruction) == lc3::OP_STR
+            ? offset(a, lc3::sign_extend_mask(instruction, 6))
+            : "m.read(" + hex(pc_relative(address, instruction, 9)) + ")";
+        fprintf(out, "    {\n        u16 a = %s;\n        if (a >= 0xFE00) %s\n"
+                     "        m.write(a, %s);\n        if (!m.translation) %s\n    }\n",
+                target.c_str(), before.c_str(), d.c_str(), after.c_str());
+    } break;
+
+    case lc3::OP_BR: {
+        u16 nzp = (instruction >> 9) & 0x7;
+        if (nzp == 0) break;
+        std::string taken = go(pc_relative(address, instruction, 9));
+        if (nzp == 0x7) {
+            fprintf(out, "    %s\n", taken.c_str());
+            break;
+        }
+        fprintf(out, "    if (%s) %s\n", condition(nzp), taken.c_str());
+        fprintf(out, "    %s\n", go(next).c_str());
+    } break;
+
+    case lc3::OP_JSR:
+        if ((instruction >> 11) & 0x1) {
+            fprintf(out, "    r7 = %s;\n", hex(next).c_str());
+            fprintf(out, "    %s\n", go(pc_relative(address, instruction, 11)).c_str());
+        } else {
+            fprintf(out, "    pc = %s;\n    r7 = %s;\n    goto dispatch;\n", a.c_str(), hex(next).c_str());
+        }
+        break;
+
+    case lc3::OP_JMP:
+        fprintf(out, "    pc = %s;\n    goto dispatch;\n", a.c_str());
+        break;
+    }
+}
+
+void translator::translate(const char* object_filename, const unsigned char* f, std::size_t n)
+{
+    std::size_t first = memory_size;
+    std::size_t last = 0;
+    for (std::size_t a = 0; a != memory_size; ++a) {
+        if (program.kinds[a] != WORD_COMPILED) continue;
+        first = std::min(first, a);
+        last = a;
+    }
+    std::vector<unsigned char> code(first <= last ? (last - first) / 8 + 1 : 1);
+    for (std::size_t a = first; a <= last && first != memory_size; ++a) {
+        if (program.kinds[a] == WORD_COMPILED) code[(a - first) / 8] |= 1 << ((a - first) % 8);
+    }
+
+    fprintf(out, "// Translated by lc3aot from %s. Do not edit.\n\n", object_filename);
+    fputs("#include \"translation.h\"\n\nnamespace {\n\nusing lc3::u16;\nusing lc3::u64;\n\n", out);
+
+    fputs("const unsigned char object[] = {", out);
+    for (std::size_t i = 0; i != n; ++i)
+        fprintf(out, "%s0x%02X,", i % 12 == 0 ? "\n    " : " ", f[i]);
+    fputs("\n};\n\nconst unsigned char code[] = {", out);
+    for (std::size_t i = 0; i != code.size(); ++i)
+        fprintf(out, "%s0x%02X,", i % 12 == 0 ? "\n    " : " ", code[i]);
+    fputs("\n};\n\n", out);
+
+    fputs("u64 run(lc3::machine& m, u64 n)\n{\n", out);
+    for (int r = 0; r != 8; ++r) fprintf(out, "    u16 r%d = m.registers[%d];\n", r, r);
+    fputs("    // The last value to set the condition codes.\n"
+          "    u16 flags = m.condition_register & lc3::FLAG_NEGATIVE ? 0x8000\n"
+          "        : m.condition_register & lc3::FLAG_ZERO ? 0 : 1;\n"
+          "    u16 pc = m.program_counter;\n"
+          "    u64 left = n;\n"
+          "    goto dispatch;\n\n", out);
+
+    for (std::size_t a = 0; a != memory_size; ++a) {
+        if (program.leaders[a] && program.kinds[a] == WORD_COMPILED)
+            emit_block(static_cast<u16>(a));
+    }
+    for (std::size_t a = 0; a != memory_size; ++a) {
+        if (stubs[a])
+            fprintf(out, "%s:\n    pc = %s;\n    goto out;\n", label(static_cast<u16>(a)).c_str(),
+                    hex(static_cast<u16>(a)).c_str());
+    }
+
+    fputs("\ndispatch:\n    switch (pc) {\n", out);
+    for (std::size_t a = 0; a != memory_size; ++a) {
+        if (program.leaders[a] && program.kinds[a] == WORD_COMPILED)
+            fprintf(out, "    case %s: goto %s;\n", hex(static_cast<u16>(a)).c_str(),
+                    label(static_cast<u16>(a)).c_str());
+    }
+    fputs("    }\n\nout:\n", out);
+    for (int r = 0; r != 8; ++r) fprintf(out, "    m.registers[%d] = r%d;\n", r, r);
+    fputs("    m.condition_register = flags == 0 ? lc3::FLAG_ZERO\n"
+          "        : flags & 0x8000 ? lc3::FLAG_NEGATIVE : lc3::FLAG_POSITIVE;\n"
+          "    m.program_counter = pc;\n"
+          "    m.instructions += n - left;\n"
+          "    return n - left;\n}\n\n} // namespace\n\n", out);
+
+    fprintf(out, "const lc3::translation_t lc3::translated_program = {\n"
+                 "    object, sizeof(object), %s, %s, %zu, code, run,\n};\n",
+            lc3::machine::segmented(object_filename) ? "true" : "false",
+            hex(static_cast<u16>(first == memory_size ? 0 : first)).c_str(),
+            first <= last && first != memory_size ? last - first + 1 : 0);
+}
+
+int main(int argc, char** argv)
+{
+    const char* object_filename = nullptr;
+    std::string output_filename;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output_filename = argv[++i];
+        else if (argv[i][0] != '-' && !object_filename) object_filename = argv[i];
+        else return usage();
+    }
+    if (!object_filename) return usage();
+    if (output_filename.empty()) {
+        output_filename = object_filename;
+        std::size_t dot = output_filename.find_last_of("./\\");
+        if (dot != std::string::npos && output_filename[dot] == '.') output_filename.erase(dot);
+        output_filename += ".cpp";
+    }
+
+    rks::mapped_file file;
+    if (!file.open(object_filename)) {
+        fprintf(stderr, "lc3aot: error: %s: %s\n", object_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    image_t image;
+    bool segmented = lc3::machine::segmented(object_filename);
+    if (!read_object(file.begin(), file.end(), segmented, image)) {
+        fprintf(stderr, "lc3aot: error: %s: %s\n", object_filename, strerror(ENOEXEC));
+        return EXIT_FAILURE;
+    }
+    program_t program;
+    explore(image, program);
+
+    FILE* out = fopen(output_filename.c_str(), "w");
+    if (!out) {
+        fprintf(stderr, "lc3aot: error: %s: %s\n", output_filename.c_str(), strerror(errno));
+        return EXIT_FAILURE;
+    }
+    translator(image, program, out).translate(object_filename, file.begin(), file.size());
+    if (ferror(out) | (fclose(out) != 0)) {
+        fprintf(stderr, "lc3aot: error: %s: %s\n", output_filename.c_str(), strerror(errno));
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
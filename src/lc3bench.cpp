@@ -0,0 +1,247 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi")
+#else
+#include <sys/resource.h>
+#endif
+#include "machine.h"
+#include "jit.h"
+#include "mapped_file.h"
+
+// Exit status when a workload ran slower than the baseline allows.
+static const int exit_slower = 2;
+
+static
+int usage()
+{
+    fputs("Usage: lc3bench [--engine=interp|jit|step] [--min-time seconds]\n"
+          "                [--baseline file] [--tolerance percent] [-o outputfile]\n"
+          "                objectfile...\n",
+          stderr);
+    return EXIT_FAILURE;
+}
+
+struct result_t {
+    std::string name;
+    lc3::u64 runs = 0;
+    lc3::u64 instructions = 0; // over all runs
+    double seconds = 0;
+
+    double instructions_per_second() const { return instructions / seconds; }
+    double ns_per_instruction() const { return seconds * 1e9 / instructions; }
+};
+
+// The object file's name without its directory and extension.
+static
+std::string workload_name(const char* filename)
+{
+    std::string name(filename);
+    std::size_t slash = name.find_last_of("/\\");
+    if (slash != std::string::npos) name.erase(0, slash + 1);
+    std::size_t dot = name.rfind('.');
+    if (dot != std::string::npos && dot != 0) name.erase(dot);
+    return name;
+}
+
+// The most memory the process has held at once, in kilobytes.
+static
+unsigned long long peak_rss_kb()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// Runs the program from the same start over and over until min_seconds have
+// passed, with no input and its output thrown away. Every run has to halt.
+static
+bool measure(const char* filename, lc3::engine_kind engine, double min_seconds, result_t& result)
+{
+    using clock = std::chrono::steady_clock;
+
+    lc3::machine machine;
+    machine.engine = engine;
+    if (!machine.load(filename)) {
+        fprintf(stderr, "lc3bench: error: %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    lc3::snapshot start = machine.save();
+
+    result.name = workload_name(filename);
+    clock::time_point begin = clock::now();
+    do {
+        lc3::string_console io;
+        machine.restore(start);
+        machine.io = &io;
+        lc3::u64 before = machine.instructions;
+        lc3::status_kind status = machine.run(lc3::limits_t());
+        if (status != lc3::STATUS_HALTED) {
+            fprintf(stderr, "lc3bench: error: %s: the program stopped without halting\n", filename);
+            return false;
+        }
+        result.instructions += machine.instructions - before;
+        ++result.runs;
+        result.seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    } while (result.seconds < min_seconds);
+    return true;
+}
+
+static
+std::string quoted(const std::string& s)
+{
+    std::string q = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') q += '\\';
+        q += c;
+    }
+    return q + '"';
+}
+
+// Writes one workload per line, which is what baseline_speed expects
+// to read back.
+static
+void write_json(FILE* out, const char* engine, const std::vector<result_t>& results)
+{
+    fprintf(out, "{\n  \"engine\": \"%s\",\n  \"workloads\": [\n", engine);
+    for (std::size_t i = 0; i != results.size(); ++i) {
+        const result_t& r = results[i];
+        fprintf(out, "    {\"name\": %s, \"runs\": %llu, \"instructions\": %llu, "
+                     "\"seconds\": %.6f, \"instructions_per_second\": %.0f, "
+                     "\"ns_per_instruction\": %.4f}%s\n",
+                quoted(r.name).c_str(), static_cast<unsigned long long>(r.runs),
+                static_cast<unsigned long long>(r.instructions), r.seconds,
+                r.instructions_per_second(), r.ns_per_instruction(),
+                i + 1 != results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"peak_rss_kb\": %llu\n}\n", peak_rss_kb());
+}
+
+// Finds the instructions per second recorded for name in the output of an
+// earlier run, or returns 0.
+static
+double baseline_speed(const std::string& baseline, const std::string& name)
+{
+    std::string key = "{\"name\": " + quoted(name) + ",";
+    std::size_t at = baseline.find(key);
+    if (at == std::string::npos) return 0;
+    std::size_t end = baseline.find('\n', at);
+    std::string field = "\"instructions_per_second\": ";
+    std::size_t value = baseline.find(field, at);
+    if (value == std::string::npos || value > end) return 0;
+    return strtod(baseline.c_str() + value + field.size(), nullptr);
+}
+
+// Prints how each workload compares with the baseline, and returns whether
+// all of them kept within tolerance percent of it.
+static
+bool compare(const std::string& baseline, const std::vector<result_t>& results, double tolerance)
+{
+    bool within = true;
+    for (const result_t& r : results) {
+        double before = baseline_speed(baseline, r.name);
+        double now = r.instructions_per_second();
+        if (before <= 0) {
+            fprintf(stderr, "%-12s %9.1f M/s  (not in the baseline)\n", r.name.c_str(), now / 1e6);
+            continue;
+        }
+        double change = (now - before) / before * 100;
+        bool slower = change < -tolerance;
+        fprintf(stderr, "%-12s %9.1f M/s  baseline %9.1f M/s  %+6.1f%%%s\n", r.name.c_str(),
+                now / 1e6, before / 1e6, change, slower ? "  SLOWER" : "");
+        if (slower) within = false;
+    }
+    return within;
+}
+
+int main(int argc, char** argv)
+{
+    lc3::engine_kind engine = lc3::ENGINE_INTERP;
+    const char* engine_name = "interp";
+    const char* baseline_filename = nullptr;
+    const char* output_filename = nullptr;
+    double min_seconds = 0.5;
+    double tolerance = 10;
+    std::vector<const char*> object_filenames;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        if (strncmp(arg, "--engine=", 9) == 0) {
+            engine_name = arg + 9;
+            if (strcmp(engine_name, "jit") == 0) engine = lc3::ENGINE_JIT;
+            else if (strcmp(engine_name, "interp") == 0) engine = lc3::ENGINE_INTERP;
+            else if (strcmp(engine_name, "step") == 0) engine = lc3::ENGINE_STEP;
+            else {
+                fprintf(stderr, "lc3bench: error: unknown engine '%s'\n", engine_name);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(arg, "--min-time") == 0 && i + 1 < argc) {
+            min_seconds = atof(argv[++i]);
+        } else if (strcmp(arg, "--baseline") == 0 && i + 1 < argc) {
+            baseline_filename = argv[++i];
+        } else if (strcmp(arg, "--tolerance") == 0 && i + 1 < argc) {
+            tolerance = atof(argv[++i]);
+        } else if (strcmp(arg, "-o") == 0 && i + 1 < argc) {
+            output_filename = argv[++i];
+        } else if (arg[0] != '-') {
+            object_filenames.push_back(arg);
+        } else {
+            return usage();
+        }
+    }
+    if (object_filenames.empty()) return usage();
+    if (engine == lc3::ENGINE_JIT && !lc3::jit::available()) {
+        fputs("lc3bench: error: the jit engine is not supported on this platform\n", stderr);
+        return EXIT_FAILURE;
+    }
+
+    // Read the baseline first, so that a missing one fails before the runs.
+    std::string baseline;
+    if (baseline_filename) {
+        rks::mapped_file file;
+        if (!file.open(baseline_filename)) {
+            fprintf(stderr, "lc3bench: error: %s: %s\n", baseline_filename, strerror(errno));
+            return EXIT_FAILURE;
+        }
+        baseline.assign(reinterpret_cast<const char*>(file.begin()), file.size());
+    }
+
+    std::vector<result_t> results;
+    for (const char* filename : object_filenames) {
+        result_t result;
+        if (!measure(filename, engine, min_seconds, result)) return EXIT_FAILURE;
+        results.push_back(result);
+    }
+
+    FILE* out = output_filename ? fopen(output_filename, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "lc3bench: error: %s: %s\n", output_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    write_json(out, engine_name, results);
+    if (output_filename && (ferror(out) | (fclose(out) != 0))) {
+        fprintf(stderr, "lc3bench: error: %s: %s\n", output_filename, strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (baseline_filename && !compare(baseline, results, tolerance)) return exit_slower;
+    return EXIT_SUCCESS;
+}
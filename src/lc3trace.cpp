@@ -0,0 +1,129 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <string>
+#include "trace.h"
+
+// Exit statuses, as for cmp and diff.
+static const int exit_same = 0;
+static const int exit_different = 1;
+static const int exit_trouble = 2;
+
+// The records shown before the first difference.
+static const std::size_t context = 5;
+
+static
+int usage()
+{
+    fputs("Usage: lc3trace dump tracefile\n"
+          "       lc3trace diff tracefile1 tracefile2\n",
+          stderr);
+    return exit_trouble;
+}
+
+static
+std::string format(const lc3::trace_record_t& x)
+{
+    char line[96];
+    if (x.kind == lc3::TRACE_INPUT) {
+        if (x.c == EOF)
+            snprintf(line, sizeof(line), "%12s  input EOF at instruction %llu", "",
+                     static_cast<unsigned long long>(x.instruction));
+        else
+            snprintf(line, sizeof(line), "%12s  input x%02X '%c' at instruction %llu", "",
+                     x.c, x.c >= 0x20 && x.c < 0x7F ? x.c : '.',
+                     static_cast<unsigned long long>(x.instruction));
+        return line;
+    }
+    snprintf(line, sizeof(line), "%12llu  x%04X",
+             static_cast<unsigned long long>(x.instruction), x.address);
+    std::string s = line;
+    for (const lc3::trace_write_t& w : x.writes) {
+        if (w.r != -1) snprintf(line, sizeof(line), "  R%d=x%04X", w.r, w.value);
+        else snprintf(line, sizeof(line), "  [x%04X]=x%04X", w.address, w.value);
+        s += line;
+    }
+    return s;
+}
+
+static
+bool same(const lc3::trace_record_t& x, const lc3::trace_record_t& y)
+{
+    if (x.kind != y.kind || x.instruction != y.instruction) return false;
+    if (x.kind == lc3::TRACE_INPUT) return x.c == y.c;
+    auto same_write = [](const lc3::trace_write_t& a, const lc3::trace_write_t& b) {
+        return a.r == b.r && a.value == b.value && (a.r != -1 || a.address == b.address);
+    };
+    return x.address == y.address
+        && std::equal(x.writes.begin(), x.writes.end(), y.writes.begin(), y.writes.end(), same_write);
+}
+
+static
+bool open(lc3::trace_reader& trace, const char* filename)
+{
+    if (trace.open(filename)) return true;
+    fprintf(stderr, "lc3trace: error: %s: %s\n", filename,
+            errno == EINVAL ? "not a trace" : strerror(errno));
+    return false;
+}
+
+static
+bool check(const lc3::trace_reader& trace, const char* filename)
+{
+    if (!trace.corrupt) return true;
+    fprintf(stderr, "lc3trace: error: %s: the trace is cut short\n", filename);
+    return false;
+}
+
+static
+int dump(const char* filename)
+{
+    lc3::trace_reader trace;
+    if (!open(trace, filename)) return exit_trouble;
+    lc3::trace_record_t x;
+    while (trace.next(x)) puts(format(x).c_str());
+    return check(trace, filename) ? exit_same : exit_trouble;
+}
+
+// Reports the first record where the traces part ways, after the few that
+// led up to it.
+static
+int diff(const char* filename1, const char* filename2)
+{
+    lc3::trace_reader trace1;
+    lc3::trace_reader trace2;
+    if (!open(trace1, filename1) || !open(trace2, filename2)) return exit_trouble;
+
+    std::deque<std::string> before;
+    lc3::trace_record_t x;
+    lc3::trace_record_t y;
+    while (true) {
+        bool more1 = trace1.next(x);
+        bool more2 = trace2.next(y);
+        if (!check(trace1, filename1) || !check(trace2, filename2)) return exit_trouble;
+        if (!more1 && !more2) return exit_same;
+        if (more1 && more2 && same(x, y)) {
+            before.push_back(format(x));
+            if (before.size() > context) before.pop_front();
+            continue;
+        }
+
+        printf("%s and %s differ:\n", filename1, filename2);
+        for (const std::string& line : before) printf("  %s\n", line.c_str());
+        if (more1) printf("< %s\n", format(x).c_str());
+        else printf("< (end of %s)\n", filename1);
+        if (more2) printf("> %s\n", format(y).c_str());
+        else printf("> (end of %s)\n", filename2);
+        return exit_different;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    if (argc == 3 && strcmp(argv[1], "dump") == 0) return dump(argv[2]);
+    if (argc == 4 && strcmp(argv[1], "diff") == 0) return diff(argv[2], argv[3]);
+    return usage();
+}
@@ -0,0 +1,223 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include "lockstep.h"
+
+namespace lc3 {
+
+namespace {
+
+struct input_t {
+    u64 instruction; // when reference read it
+    int c;
+};
+
+// What reference has read and written that candidate has yet to.
+struct shared_io_t {
+    std::deque<input_t> input;
+    std::string output;
+    u64 written = 0; // by reference, in all
+    bool output_differs = false;
+};
+
+// Reference's console: the real one, with everything passing through
+// recorded for candidate.
+class leader_console : public console {
+public:
+    leader_console(console& inner, shared_io_t& shared, const machine& m) :
+        inner(inner), shared(shared), m(m)
+    { }
+
+    int get() override { return record(inner.get()); }
+    int try_get() override { return record(inner.try_get()); }
+
+    void put(int c) override
+    {
+        char x = static_cast<char>(c);
+        write(&x, 1);
+    }
+
+    void write(const char* s, std::size_t n) override
+    {
+        inner.write(s, n);
+        shared.output.append(s, n);
+        shared.written += n;
+    }
+
+    void flush() override { inner.flush(); }
+
+private:
+    console& inner;
+    shared_io_t& shared;
+    const machine& m;
+
+    int record(int c)
+    {
+        if (c != empty) shared.input.push_back(input_t{m.instructions, c});
+        return c;
+    }
+};
+
+// Candidate's console: replays reference's input and checks its output.
+class follower_console : public console {
+public:
+    follower_console(shared_io_t& shared, const machine& m) :
+        shared(shared), m(m)
+    { }
+
+    // Input that reference never read ends candidate's.
+    int get() override
+    {
+        if (shared.input.empty()) return EOF;
+        int c = shared.input.front().c;
+        shared.input.pop_front();
+        return c;
+    }
+
+    int try_get() override
+    {
+        if (shared.input.empty() || shared.input.front().instruction > m.instructions)
+            return empty;
+        return get();
+    }
+
+    void put(int c) override
+    {
+        char x = static_cast<char>(c);
+        write(&x, 1);
+    }
+
+    void write(const char* s, std::size_t n) override
+    {
+        if (shared.output_differs) return;
+        if (shared.output.compare(0, n, s, n) != 0) shared.output_differs = true;
+        else shared.output.erase(0, n);
+    }
+
+private:
+    shared_io_t& shared;
+    const machine& m;
+};
+
+const char* const status_names[] = {
+    "running", "halted", "invalid", "waiting", "end of input",
+    "instruction limit", "time limit", "output limit",
+};
+
+void differ(std::string& differences, const char* what, unsigned x, unsigned y)
+{
+    char line[64];
+    snprintf(line, sizeof(line), "%-12s x%04X  x%04X\n", what, x, y);
+    differences += line;
+}
+
+void differ(std::string& differences, const char* what, const char* x, const char* y)
+{
+    char line[96];
+    snprintf(line, sizeof(line), "%-12s %s  %s\n", what, x, y);
+    differences += line;
+}
+
+// Appends a line for everything that tells the machines apart.
+void compare(const machine& x, status_kind x_status, const machine& y, status_kind y_status,
+             const shared_io_t& io, std::string& differences)
+{
+    if (x_status != y_status)
+        differ(differences, "status", status_names[x_status], status_names[y_status]);
+    if (x.instructions != y.instructions) {
+        std::string a = std::to_string(x.instructions);
+        std::string b = std::to_string(y.instructions);
+        differ(differences, "instructions", a.c_str(), b.c_str());
+    }
+    if (x.program_counter != y.program_counter)
+        differ(differences, "PC", x.program_counter, y.program_counter);
+    for (int r = 0; r != 8; ++r) {
+        if (x.registers[r] == y.registers[r]) continue;
+        char name[4] = {'R', static_cast<char>('0' + r)};
+        differ(differences, name, x.registers[r], y.registers[r]);
+    }
+    if (x.condition_register != y.condition_register)
+        differ(differences, "NZP", x.condition_register, y.condition_register);
+    if (x.processor_status != y.processor_status)
+        differ(differences, "PSR", x.processor_status, y.processor_status);
+    if (x.saved_ssp != y.saved_ssp) differ(differences, "Saved.SSP", x.saved_ssp, y.saved_ssp);
+    if (x.saved_usp != y.saved_usp) differ(differences, "Saved.USP", x.saved_usp, y.saved_usp);
+    if (x.keyboard_status != y.keyboard_status)
+        differ(differences, "KBSR", x.keyboard_status, y.keyboard_status);
+    if (x.keyboard_data != y.keyboard_data)
+        differ(differences, "KBDR", x.keyboard_data, y.keyboard_data);
+    if (x.display_status != y.display_status)
+        differ(differences, "DSR", x.display_status, y.display_status);
+    u16 address;
+    if (!x.same_memory(y, address)) {
+        char name[16];
+        snprintf(name, sizeof(name), "[x%04X]", address);
+        differ(differences, name, x.read(address), y.read(address));
+    }
+    if (io.output_differs || !io.output.empty())
+        differ(differences, "output", "", "differs");
+}
+
+} // namespace
+
+status_kind run_lockstep(machine& reference, machine& candidate, const limits_t& limits,
+                         u64 interval, divergence_t& divergence)
+{
+    using clock = std::chrono::steady_clock;
+
+    shared_io_t shared;
+    console* io = reference.io;
+    leader_console leader(*io, shared, reference);
+    follower_console follower(shared, candidate);
+    console* candidate_io = candidate.io;
+    reference.io = &leader;
+    candidate.io = &follower;
+
+    bool timed = limits.seconds < std::numeric_limits<double>::infinity();
+    clock::time_point deadline;
+    if (timed)
+        deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(std::max(limits.seconds, 0.0)));
+
+    divergence = divergence_t();
+    u64 left = limits.instructions;
+    interval = std::max(interval, u64(1));
+    status_kind status;
+    while (true) {
+        if (left == 0) {
+            status = STATUS_INSTRUCTION_LIMIT;
+            break;
+        }
+        limits_t granule;
+        granule.instructions = std::min(left, interval);
+        granule.output = limits.output - std::min(limits.output, shared.written);
+
+        u64 first = reference.instructions;
+        status = reference.run(granule);
+        status_kind candidate_status = candidate.run(granule);
+        if (status == STATUS_INSTRUCTION_LIMIT) status = STATUS_RUNNING;
+        if (candidate_status == STATUS_INSTRUCTION_LIMIT) candidate_status = STATUS_RUNNING;
+
+        compare(reference, status, candidate, candidate_status, shared, divergence.differences);
+        if (!divergence.differences.empty()) {
+            divergence.found = true;
+            divergence.first = first;
+            divergence.last = reference.instructions;
+            break;
+        }
+        if (status != STATUS_RUNNING) break;
+        left -= granule.instructions;
+        if (timed && clock::now() >= deadline) {
+            status = STATUS_TIME_LIMIT;
+            break;
+        }
+    }
+
+    reference.io = io;
+    candidate.io = candidate_io;
+    return status;
+}
+
+} // namespace lc3
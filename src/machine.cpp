@@ -0,0 +1,1229 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <iterator>
+#include <type_traits>
+#include "byte_order.h"
+#include "mapped_file.h"
+#include "machine.h"
+#include "jit.h"
+#include "memory_profile.h"
+#include "profile.h"
+#include "trace.h"
+#include "translation.h"
+
+namespace lc3 {
+
+// Every word of memory has a pre-decoded shadow record. Records start out as
+// X_DECODE and are filled in the first time the word is executed; stores reset
+// the record of the word they overwrite so self-modifying code still works.
+enum {
+    X_DECODE,
+    X_BR,
+    X_ADD,
+    X_ADD_IMM,
+    X_LD,
+    X_ST,
+    X_JSR,
+    X_JSRR,
+    X_AND,
+    X_AND_IMM,
+    X_LDR,
+    X_STR,
+    X_NOT,
+    X_LDI,
+    X_STI,
+    X_JMP,
+    X_LEA,
+    X_TRAP,
+    X_STEP,
+    X_ADD_IMM_BR,
+    X_LDR_BR,
+};
+
+struct decoded_t {
+    std::uint8_t handler;
+    std::uint8_t destination;
+    std::uint8_t source1;
+    std::uint8_t source2;
+    u16 operand; // sign-extended immediate, absolute address or trap vector
+};
+
+static
+decoded_t decode(u16 instruction, u16 address)
+{
+    u16 next = address + 1;
+    decoded_t d{};
+    d.destination = (instruction >> 9) & 0x7;
+    d.source1 = (instruction >> 6) & 0x7;
+    d.source2 = instruction & 0x7;
+    switch (instruction >> 12) {
+    case OP_BR:
+        d.handler = X_BR;
+        d.operand = next + sign_extend_mask(instruction, 9);
+        break;
+    case OP_ADD:
+    case OP_AND: {
+        bool immediate = (instruction >> 5) & 0x1;
+        if (instruction >> 12 == OP_ADD) d.handler = immediate ? X_ADD_IMM : X_ADD;
+        else d.handler = immediate ? X_AND_IMM : X_AND;
+        d.operand = sign_extend_mask(instruction, 5);
+    } break;
+    case OP_LD:  d.handler = X_LD;  d.operand = next + sign_extend_mask(instruction, 9); break;
+    case OP_ST:  d.handler = X_ST;  d.operand = next + sign_extend_mask(instruction, 9); break;
+    case OP_LDI: d.handler = X_LDI; d.operand = next + sign_extend_mask(instruction, 9); break;
+    case OP_STI: d.handler = X_STI; d.operand = next + sign_extend_mask(instruction, 9); break;
+    case OP_LEA: d.handler = X_LEA; d.operand = next + sign_extend_mask(instruction, 9); break;
+    case OP_LDR: d.handler = X_LDR; d.operand = sign_extend_mask(instruction, 6); break;
+    case OP_STR: d.handler = X_STR; d.operand = sign_extend_mask(instruction, 6); break;
+    case OP_JSR:
+        if ((instruction >> 11) & 0x1) {
+            d.handler = X_JSR;
+            d.operand = next + sign_extend_mask(instruction, 11);
+        } else d.handler = X_JSRR;
+        break;
+    case OP_NOT:  d.handler = X_NOT; break;
+    case OP_JMP:  d.handler = X_JMP; break;
+    case OP_TRAP: d.handler = X_TRAP; d.operand = instruction & 0xFF; break;
+    case OP_RTI:
+    case OP_INVALID:
+        d.handler = X_STEP;
+        break;
+    }
+    // Device registers at a fixed address are always left to step.
+    switch (d.handler) {
+    case X_LD: case X_ST: case X_LDI: case X_STI:
+        if (d.operand >= DEVICE_BASE) d.handler = X_STEP;
+        break;
+    default:
+        break;
+    }
+    return d;
+}
+
+// Superinstructions: a flag-producing instruction followed by a BR runs as
+// one handler. The BR's own record is looked up when the pair executes, so
+// overwriting either word still takes effect.
+static
+void fuse(decoded_t& d, u16 next_instruction)
+{
+    if (next_instruction >> 12 != OP_BR) return;
+    if (d.handler == X_ADD_IMM) d.handler = X_ADD_IMM_BR;
+    else if (d.handler == X_LDR) d.handler = X_LDR_BR;
+}
+
+// What every page of memory holds until something is written to it. The
+// page is never written to: holding a reference keeps it shared.
+static
+const std::shared_ptr<machine::page_t>& zero_page()
+{
+    static const std::shared_ptr<machine::page_t> page = std::make_shared<machine::page_t>();
+    return page;
+}
+
+// The records of a page that has not been decoded yet.
+static const decoded_t blank_records[machine::page_size] = {};
+
+machine::machine()
+{
+    for (std::size_t i(0); i < page_count; ++i) {
+        pages[i] = zero_page();
+        readable[i] = pages[i]->words;
+        writable[i] = nullptr;
+    }
+    reset_decoded();
+}
+
+machine::machine(const snapshot& x)
+{
+    reset_decoded();
+    restore(x);
+}
+
+machine::~machine() = default;
+
+// Checks the segments of a segmented object file, calling
+// f(origin, words, count) for each. Returns false if the file is malformed.
+template <typename F>
+// requires Procedure(F) && Arity(F) == 3
+static
+bool for_each_segment(const unsigned char* f, const unsigned char* l, F f_segment)
+{
+    while (f != l) {
+        if (l - f < 4) return false;
+        u16 origin, count;
+        f = rks::load_big_endian(origin, f);
+        f = rks::load_big_endian(count, f);
+        if (std::size_t(l - f) / 2 < count || origin + std::size_t(count) > machine::memory_size)
+            return false;
+        f_segment(origin, f, count);
+        f += 2 * std::size_t(count);
+    }
+    return true;
+}
+
+bool machine::load(const char* filename)
+{
+    rks::mapped_file file;
+    if (!file.open(filename)) return false;
+    if (segmented(filename)) return load_segmented(file.begin(), file.size());
+    return load(file.begin(), file.size());
+}
+
+bool machine::load(const unsigned char* f, std::size_t n)
+{
+    if (n < 2 || n % 2 != 0) {
+        errno = ENOEXEC;
+        return false;
+    }
+    u16 origin;
+    f = rks::load_big_endian(origin, f);
+    std::size_t count = (n - 2) / 2;
+    if (origin + count > memory_size) {
+        errno = ENOEXEC;
+        return false;
+    }
+    load_big_endian(origin, f, count);
+    program_counter = origin;
+    invalidate_all();
+    return true;
+}
+
+bool machine::load_segmented(const unsigned char* f, std::size_t n)
+{
+    const unsigned char* l = f + n;
+    static const unsigned char magic[4] = { 'L', 'C', '3', 'S' };
+    auto ignore = [](u16, const unsigned char*, std::size_t) { };
+    if (n < 6 || !std::equal(magic, magic + 4, f) || !for_each_segment(f + 6, l, ignore)) {
+        errno = ENOEXEC;
+        return false;
+    }
+    u16 entry;
+    f = rks::load_big_endian(entry, f + 4);
+    for_each_segment(f, l, [this](u16 origin, const unsigned char* words, std::size_t count) {
+        load_big_endian(origin, words, count);
+    });
+    program_counter = entry;
+    invalidate_all();
+    return true;
+}
+
+// Byte-swaps n words from f straight into the pages from origin on. The
+// caller invalidates the decoded records.
+void machine::load_big_endian(u16 origin, const unsigned char* f, std::size_t n)
+{
+    std::size_t address = origin;
+    while (n != 0) {
+        std::size_t page = address >> page_bits;
+        std::size_t offset = address & (page_size - 1);
+        std::size_t count = std::min(n, page_size - offset);
+        u16* words = writable[page] ? writable[page] : make_writable(page);
+        rks::load_big_endian_n(f, count, words + offset);
+        f += 2 * count;
+        address += count;
+        n -= count;
+    }
+}
+
+void machine::load(u16 origin, const u16* f, const u16* l)
+{
+    program_counter = origin;
+    while (f != l) write(origin++, *f++);
+}
+
+void machine::write(u16 address, u16 value)
+{
+    store(address, value);
+    invalidate(address);
+}
+
+u16* machine::make_writable(std::size_t page)
+{
+    // Nobody else can take a new reference to a page only we hold.
+    if (pages[page].use_count() != 1)
+        pages[page] = std::make_shared<page_t>(*pages[page]);
+    readable[page] = writable[page] = pages[page]->words;
+    return writable[page];
+}
+
+snapshot machine::save()
+{
+    snapshot x;
+    std::copy(std::begin(registers), std::end(registers), x.registers);
+    x.program_counter = program_counter;
+    x.condition_register = condition_register;
+    x.processor_status = processor_status;
+    x.saved_ssp = saved_ssp;
+    x.saved_usp = saved_usp;
+    x.keyboard_status = keyboard_status;
+    x.keyboard_data = keyboard_data;
+    x.display_status = display_status;
+    x.instructions = instructions;
+    x.prompted = prompted;
+    for (std::size_t i(0); i < page_count; ++i) {
+        x.pages[i] = pages[i];
+        writable[i] = nullptr;
+    }
+    return x;
+}
+
+void machine::restore(const snapshot& x)
+{
+    std::copy(std::begin(x.registers), std::end(x.registers), registers);
+    program_counter = x.program_counter;
+    condition_register = x.condition_register;
+    processor_status = x.processor_status;
+    saved_ssp = x.saved_ssp;
+    saved_usp = x.saved_usp;
+    keyboard_status = x.keyboard_status;
+    keyboard_data = x.keyboard_data;
+    display_status = x.display_status;
+    instructions = x.instructions;
+    prompted = x.prompted;
+    waited_at = ~u64(0);
+    for (std::size_t i(0); i < page_count; ++i) {
+        pages[i] = x.pages[i];
+        readable[i] = pages[i]->words;
+        writable[i] = nullptr;
+    }
+    invalidate_all();
+}
+
+bool machine::same_memory(const machine& other, u16& address) const
+{
+    for (std::size_t i = 0; i != page_count; ++i) {
+        if (readable[i] == other.readable[i]) continue;
+        auto mismatch = std::mismatch(readable[i], readable[i] + page_size, other.readable[i]);
+        if (mismatch.first != readable[i] + page_size) {
+            address = static_cast<u16>(i * page_size + (mismatch.first - readable[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+std::size_t machine::resident_pages() const
+{
+    const page_t* zero = zero_page().get();
+    return static_cast<std::size_t>(std::count_if(std::begin(pages), std::end(pages),
+        [zero](const std::shared_ptr<page_t>& x) { return x.get() != zero; }));
+}
+
+std::size_t machine::private_pages() const
+{
+    return static_cast<std::size_t>(std::count_if(std::begin(pages), std::end(pages),
+        [](const std::shared_ptr<page_t>& x) { return x.use_count() == 1; }));
+}
+
+decoded_t* machine::make_decoded(std::size_t page)
+{
+    decoded_pages[page].reset(new decoded_t[page_size]());
+    decoded[page] = decoded_pages[page].get();
+    return decoded_pages[page].get();
+}
+
+void machine::invalidate_decoded(u16 address)
+{
+    if (decoded_t* page = decoded_pages[address >> page_bits].get())
+        page[address & (page_size - 1)].handler = X_DECODE;
+}
+
+void machine::reset_decoded()
+{
+    for (std::size_t i(0); i < page_count; ++i) {
+        decoded_pages[i].reset();
+        decoded[i] = blank_records;
+    }
+}
+
+void machine::invalidate(u16 address)
+{
+    invalidate_decoded(address);
+    if (jit_engine) jit_engine->invalidate(address);
+    if (translation && translation->covers(address)) translation = nullptr;
+}
+
+void machine::invalidate_all()
+{
+    reset_decoded();
+    jit_engine.reset();
+}
+
+static inline
+u16 condition_codes(u16 x)
+{
+    if (x == 0) return FLAG_ZERO;
+    if (x >> 15) return FLAG_NEGATIVE;
+    return FLAG_POSITIVE;
+}
+
+// A value whose condition codes are cc.
+static inline
+u16 flag_value(u16 cc)
+{
+    if (cc & FLAG_NEGATIVE) return 0x8000;
+    if (cc & FLAG_ZERO) return 0;
+    return 1;
+}
+
+void machine::set_condition_codes(u16 x)
+{
+    condition_register = condition_codes(x);
+}
+
+// Passes s on to the console as long as the output limit allows. Returns
+// false once the program has tried to print more than that.
+bool machine::output(const char* s, std::size_t n)
+{
+    if (n > output_left) {
+        io->write(s, static_cast<std::size_t>(output_left));
+        output_left = 0;
+        return false;
+    }
+    io->write(s, n);
+    output_left -= n;
+    return true;
+}
+
+// Returns STATUS_RUNNING unless the program has halted, hit the output limit,
+// or has to wait for input. When waiting, or when there is no more input,
+// nothing has happened yet but IN's prompt, which the retry leaves out.
+status_kind machine::trap(u16 vector)
+{
+    switch (vector) {
+    case TRAP_GETC: {
+        int c = io->get();
+        if (c == console::empty) return STATUS_WAITING;
+        if (c == EOF) return STATUS_END_OF_INPUT;
+        registers[0] = static_cast<u16>(c);
+    } break;
+    case TRAP_OUT: {
+        char c = static_cast<char>(registers[0]);
+        if (!output(&c, 1)) return STATUS_OUTPUT_LIMIT;
+    } break;
+    case TRAP_PUTS:
+    case TRAP_PUTSP: {
+        // Strings go to the console in chunks rather than a call per character.
+        // A string without a terminator ends after wrapping around memory once.
+        char chunk[256];
+        std::size_t n = 0;
+        u16 a = registers[0];
+        for (std::size_t i = 0; i != memory_size && read(a); ++i, ++a) {
+            u16 x = read(a);
+            if (n > sizeof(chunk) - 2) {
+                if (!output(chunk, n)) return STATUS_OUTPUT_LIMIT;
+                n = 0;
+            }
+            if (vector == TRAP_PUTS) {
+                chunk[n++] = static_cast<char>(x);
+            } else {
+                chunk[n++] = static_cast<char>(x & 0xFF);
+                if (x >> 8) chunk[n++] = static_cast<char>(x >> 8);
+            }
+        }
+        if (!output(chunk, n)) return STATUS_OUTPUT_LIMIT;
+    } break;
+    case TRAP_IN: {
+        if (!prompted) {
+            static const char prompt[] = "Enter the character: \n";
+            if (!output(prompt, sizeof(prompt) - 1)) return STATUS_OUTPUT_LIMIT;
+            prompted = true;
+        }
+        int c = io->get();
+        if (c == console::empty) return STATUS_WAITING;
+        if (c == EOF) return STATUS_END_OF_INPUT;
+        prompted = false;
+        char echo = static_cast<char>(c);
+        if (!output(&echo, 1)) return STATUS_OUTPUT_LIMIT;
+        registers[0] = static_cast<unsigned char>(c);
+    } break;
+    case TRAP_HALT: {
+        static const char message[] = "\nprogram finished\n";
+        io->write(message, sizeof(message) - 1);
+        io->flush();
+        return STATUS_HALTED;
+    }
+    }
+    return STATUS_RUNNING;
+}
+
+// How close together two reads of KBSR from the same instruction have to be
+// to count as a polling loop.
+static const u64 poll_window = 16;
+
+// Makes the next key, if there is one, available in keyboard_data. With
+// block set, waits for it.
+status_kind machine::poll_keyboard(bool block)
+{
+    if (keyboard_status & DEVICE_READY) return STATUS_RUNNING;
+    int c = block ? io->get() : io->try_get();
+    if (c == console::empty) return block ? STATUS_WAITING : STATUS_RUNNING;
+    if (c == EOF) return block ? STATUS_END_OF_INPUT : STATUS_RUNNING;
+    keyboard_data = static_cast<unsigned char>(c);
+    keyboard_status |= DEVICE_READY;
+    return STATUS_RUNNING;
+}
+
+// Called by step for the instruction before program_counter.
+u16 machine::load_device(u16 address)
+{
+    switch (address) {
+    case DEVICE_KBSR:
+        if (!(keyboard_status & DEVICE_READY)) {
+            // Coming back to the same read so soon means the program has
+            // nothing better to do than wait for the key.
+            u16 self = program_counter - 1;
+            bool polling = self == poll_address && instructions - poll_instructions <= poll_window;
+            device_status = poll_keyboard(polling);
+            poll_address = self;
+            poll_instructions = instructions;
+        }
+        return keyboard_status;
+    case DEVICE_KBDR:
+        keyboard_status &= ~DEVICE_READY;
+        return keyboard_data;
+    case DEVICE_DSR:
+        return display_status;
+    case DEVICE_DDR:
+        return 0;
+    case DEVICE_PSR:
+        return processor_status | condition_register;
+    case DEVICE_MCR:
+        return MCR_CLOCK_ENABLE;
+    }
+    return read(address);
+}
+
+void machine::store_device(u16 address, u16 value)
+{
+    switch (address) {
+    case DEVICE_KBSR:
+        // run has to start watching the keyboard.
+        if (value & ~keyboard_status & DEVICE_INTERRUPT_ENABLE) yield = true;
+        keyboard_status = (keyboard_status & DEVICE_READY) | (value & DEVICE_INTERRUPT_ENABLE);
+        return;
+    case DEVICE_KBDR:
+        return;
+    case DEVICE_DSR:
+        display_status = DEVICE_READY | (value & DEVICE_INTERRUPT_ENABLE);
+        return;
+    case DEVICE_DDR: {
+        char c = static_cast<char>(value);
+        if (!output(&c, 1)) device_status = STATUS_OUTPUT_LIMIT;
+    } return;
+    case DEVICE_PSR:
+        // Only the supervisor can change it.
+        if (!(processor_status & PSR_USER)) set_processor_status(value);
+        return;
+    case DEVICE_MCR:
+        if (!(value & MCR_CLOCK_ENABLE)) {
+            io->flush();
+            device_status = STATUS_HALTED;
+        }
+        return;
+    }
+    write(address, value);
+}
+
+// Takes the privilege and priority from psr, and the condition codes when
+// exactly one of them is set.
+void machine::set_processor_status(u16 psr)
+{
+    processor_status = psr & (PSR_USER | PSR_PRIORITY);
+    u16 cc = psr & 0x7;
+    if (cc == FLAG_NEGATIVE || cc == FLAG_ZERO || cc == FLAG_POSITIVE) condition_register = cc;
+}
+
+// Pushes the processor status and program counter on the supervisor stack
+// and continues at the handler for vector, telling observer about the pushes
+// and R6.
+template <typename Observer>
+void machine::enter_interrupt(u16 vector, u16 priority, Observer& observer)
+{
+    u16 psr = processor_status | condition_register;
+    if (processor_status & PSR_USER) {
+        saved_usp = registers[6];
+        registers[6] = saved_ssp;
+    }
+    write(--registers[6], psr);
+    observer.write_memory(registers[6], psr);
+    write(--registers[6], program_counter);
+    observer.write_memory(registers[6], program_counter);
+    observer.write_register(6, registers[6]);
+    processor_status = static_cast<u16>(priority << 8);
+    program_counter = read(INTERRUPT_TABLE + vector);
+}
+
+// Raises an exception for the instruction before program_counter. Without a
+// handler in the table, stops on that instruction with STATUS_INVALID.
+template <typename Observer>
+status_kind machine::exception(u16 vector, Observer& observer)
+{
+    if (!read(INTERRUPT_TABLE + vector)) {
+        --program_counter;
+        return STATUS_INVALID;
+    }
+    enter_interrupt(vector, (processor_status & PSR_PRIORITY) >> 8, observer);
+    ++instructions;
+    return STATUS_RUNNING;
+}
+
+namespace {
+
+// What step and run_interp report to when nobody is watching.
+struct null_observer {
+    void execute(u16) { }
+    void branch(u16, bool) { }
+    void call(u16) { }
+    void write_register(u16, u16) { }
+    void write_memory(u16, u16) { }
+};
+
+// Whether step and run_interp report anything to Observer.
+template <typename Observer>
+struct observing : std::integral_constant<bool, !std::is_same<Observer, null_observer>::value> { };
+
+// Reports to two observers at once.
+template <typename First, typename Second>
+struct observer_pair {
+    First& first;
+    Second& second;
+
+    void execute(u16 address)
+    {
+        first.execute(address);
+        second.execute(address);
+    }
+
+    void branch(u16 address, bool taken)
+    {
+        first.branch(address, taken);
+        second.branch(address, taken);
+    }
+
+    void call(u16 target)
+    {
+        first.call(target);
+        second.call(target);
+    }
+
+    void write_register(u16 r, u16 value)
+    {
+        first.write_register(r, value);
+        second.write_register(r, value);
+    }
+
+    void write_memory(u16 address, u16 value)
+    {
+        first.write_memory(address, value);
+        second.write_memory(address, value);
+    }
+};
+
+} // namespace
+
+status_kind machine::step()
+{
+    null_observer observer;
+    return step(observer);
+}
+
+// Keeps the rarely taken calls to step from run_interp out of its loop.
+#if defined(__GNUC__)
+#define LC3_NOINLINE __attribute__((noinline))
+#elif defined(_MSC_VER)
+#define LC3_NOINLINE __declspec(noinline)
+#else
+#define LC3_NOINLINE
+#endif
+
+// Tells observer about the registers and memory the instruction writes, but
+// not about the instruction itself.
+template <typename Observer>
+LC3_NOINLINE
+status_kind machine::step(Observer& observer)
+{
+    u16 instruction = read(program_counter);
+    auto get_register = [this, instruction](int n) -> u16& {
+        return registers[(instruction >> n) & 0x7];
+    };
+    auto set_destination = [this, instruction, &observer](u16 value) {
+        u16 r = (instruction >> 9) & 0x7;
+        registers[r] = value;
+        set_condition_codes(value);
+        observer.write_register(r, value);
+    };
+    auto store_word = [this, &observer](u16 address, u16 value) {
+        if (address >= DEVICE_BASE) store_device(address, value);
+        else write(address, value);
+        observer.write_memory(address, value);
+    };
+
+    u16 address = program_counter++;
+    device_status = STATUS_RUNNING;
+    switch (instruction >> 12) {
+    case OP_BR: {
+        if (((instruction >> 9) & 0x7) & condition_register)
+            program_counter += sign_extend_mask(instruction, 9);
+    } break;
+
+    case OP_ADD: {
+        u16 source1 = get_register(6);
+        if ((instruction >> 5u) & 0x1)
+            set_destination(source1 + sign_extend_mask(instruction, 5));
+        else
+            set_destination(source1 + get_register(0));
+    } break;
+
+    case OP_LD: {
+        u16 value = load(u16(program_counter + sign_extend_mask(instruction, 9)));
+        if (device_status != STATUS_RUNNING) break;
+        set_destination(value);
+    } break;
+
+    case OP_ST: {
+        store_word(program_counter + sign_extend_mask(instruction, 9), get_register(9));
+    } break;
+
+    case OP_JSR: {
+        u16 target = get_register(6);
+        registers[7] = program_counter;
+        observer.write_register(7, program_counter);
+        if ((instruction >> 11) & 0x1)
+            program_counter += sign_extend_mask(instruction, 11);
+        else
+            program_counter = target;
+    } break;
+
+    case OP_AND: {
+        u16 source1 = get_register(6);
+        if ((instruction >> 5u) & 0x1)
+            set_destination(source1 & sign_extend_mask(instruction, 5));
+        else
+            set_destination(source1 & get_register(0));
+    } break;
+
+    case OP_LDR: {
+        u16 value = load(u16(get_register(6) + sign_extend_mask(instruction, 6)));
+        if (device_status != STATUS_RUNNING) break;
+        set_destination(value);
+    } break;
+
+    case OP_STR: {
+        store_word(get_register(6) + sign_extend_mask(instruction, 6), get_register(9));
+    } break;
+
+    case OP_NOT: {
+        set_destination(~get_register(6));
+    } break;
+
+    case OP_LDI: {
+        u16 pointer = load(u16(program_counter + sign_extend_mask(instruction, 9)));
+        if (device_status != STATUS_RUNNING) break;
+        u16 value = load(pointer);
+        if (device_status != STATUS_RUNNING) break;
+        set_destination(value);
+    } break;
+
+    case OP_STI: {
+        u16 pointer = load(u16(program_counter + sign_extend_mask(instruction, 9)));
+        if (device_status != STATUS_RUNNING) break;
+        store_word(pointer, get_register(9));
+    } break;
+
+    case OP_JMP: {
+        program_counter = get_register(6);
+    } break;
+
+    case OP_LEA: {
+        set_destination(program_counter + sign_extend_mask(instruction, 9));
+    } break;
+
+    case OP_TRAP: {
+        u16 vector = instruction & 0xFF;
+        u16 before[7];
+        std::copy(registers, registers + 7, before);
+        u16 saved = 0;
+        u16 saved_count = 0;
+        status_kind status = os == OS_NONE ? trap(vector) : os_trap(vector, saved, saved_count);
+        if (status == STATUS_WAITING || status == STATUS_END_OF_INPUT) {
+            --program_counter;
+            if (observing<Observer>::value) waited_at = instructions;
+            return status;
+        }
+        for (u16 i = 0; i != saved_count; ++i) observer.write_memory(saved + i, read(saved + i));
+        // A character read counts as a write even when R0 held it already.
+        for (u16 r = 0; r != 7; ++r) {
+            bool got = r == 0 && (vector == TRAP_GETC || vector == TRAP_IN);
+            if (got || registers[r] != before[r]) observer.write_register(r, registers[r]);
+        }
+        if (os != OS_NONE) observer.write_register(7, registers[7]);
+        ++instructions;
+        return status;
+    }
+
+    case OP_RTI: {
+        if (processor_status & PSR_USER) return exception(VECTOR_PRIVILEGE, observer);
+        program_counter = read(registers[6]++);
+        set_processor_status(read(registers[6]++));
+        if (processor_status & PSR_USER) {
+            saved_ssp = registers[6];
+            registers[6] = saved_usp;
+        }
+        observer.write_register(6, registers[6]);
+    } break;
+
+    case OP_INVALID:
+        return exception(VECTOR_ILLEGAL_OPCODE, observer);
+    }
+
+    if (device_status != STATUS_RUNNING) {
+        // Waiting for a key leaves the instruction to be run again.
+        if (device_status == STATUS_WAITING || device_status == STATUS_END_OF_INPUT) {
+            program_counter = address;
+            if (observing<Observer>::value) waited_at = instructions;
+            return device_status;
+        }
+        ++instructions;
+        return device_status;
+    }
+    ++instructions;
+    return STATUS_RUNNING;
+}
+
+status_kind machine::run(u64 n)
+{
+    // Instructions between looks at the keyboard while its interrupt is on.
+    const u64 interval = 4096;
+    while (n) {
+        u64 chunk = n;
+        if (keyboard_status & DEVICE_INTERRUPT_ENABLE) {
+            // A BR to itself can only be waiting for the interrupt.
+            bool idle = read(program_counter) == 0x0FFF;
+            status_kind status = poll_keyboard(idle);
+            if (status != STATUS_RUNNING) return status;
+            if ((keyboard_status & DEVICE_READY) && (processor_status & PSR_PRIORITY) >> 8 < 4)
+                interrupt(VECTOR_KEYBOARD, 4);
+            chunk = std::min(n, interval);
+        }
+        // The engine stops early when the program turns the interrupt on.
+        yield = false;
+        u64 before = instructions;
+        status_kind status = run_engine(chunk);
+        if (status != STATUS_RUNNING) return status;
+        n -= std::min(n, instructions - before);
+    }
+    return STATUS_RUNNING;
+}
+
+// Enters an interrupt between instructions. The writes go to the tracer and
+// the memory profiler, as part of the instruction before.
+void machine::interrupt(u16 vector, u16 priority)
+{
+    if (tracer && memory_profiler) {
+        observer_pair<trace_writer, memory_profile> both{*tracer, *memory_profiler};
+        enter_interrupt(vector, priority, both);
+    } else if (tracer) {
+        enter_interrupt(vector, priority, *tracer);
+    } else if (memory_profiler) {
+        enter_interrupt(vector, priority, *memory_profiler);
+    } else {
+        null_observer observer;
+        enter_interrupt(vector, priority, observer);
+    }
+}
+
+status_kind machine::run_engine(u64 n)
+{
+    bool observed = profiler || memory_profiler || tracer;
+    if (engine == ENGINE_JIT && jit::available() && !observed) {
+        reset_decoded();
+        return run_jit(n);
+    }
+    jit_engine.reset();
+    if (engine == ENGINE_AOT && translation && !observed) {
+        reset_decoded();
+        return run_aot(n);
+    }
+    if (engine == ENGINE_STEP && !profiler && !memory_profiler) {
+        reset_decoded();
+        if (tracer) return run_step(n, *tracer);
+        null_observer observer;
+        return run_step(n, observer);
+    }
+    if (memory_profiler) return run_memory_profiled(n);
+    if (profiler && tracer) {
+        observer_pair<profile, trace_writer> both{*profiler, *tracer};
+        return run_interp(n, both);
+    }
+    if (profiler) return run_interp(n, *profiler);
+    if (tracer) return run_interp(n, *tracer);
+    null_observer observer;
+    return run_interp(n, observer);
+}
+
+// Runs the interpreter for the memory profiler and whatever else is watching.
+status_kind machine::run_memory_profiled(u64 n)
+{
+    memory_profile& memory = *memory_profiler;
+    if (profiler && tracer) {
+        observer_pair<profile, trace_writer> both{*profiler, *tracer};
+        observer_pair<observer_pair<profile, trace_writer>, memory_profile> all{both, memory};
+        return run_interp(n, all);
+    }
+    if (profiler) {
+        observer_pair<profile, memory_profile> both{*profiler, memory};
+        return run_interp(n, both);
+    }
+    if (tracer) {
+        observer_pair<trace_writer, memory_profile> both{*tracer, memory};
+        return run_interp(n, both);
+    }
+    return run_interp(n, memory);
+}
+
+template <typename Observer>
+status_kind machine::run_step(u64 n, Observer& observer)
+{
+    status_kind status = STATUS_RUNNING;
+    while (n-- && status == STATUS_RUNNING && !yield) {
+        // An instruction run again after waiting for input was observed the
+        // first time round.
+        if (waited_at != instructions) observer.execute(program_counter);
+        status = step(observer);
+    }
+    return status;
+}
+
+status_kind machine::run(const limits_t& limits)
+{
+    using clock = std::chrono::steady_clock;
+    // Instructions between looks at the clock, a few milliseconds' worth.
+    const u64 slice = u64(1) << 20;
+
+    bool timed = limits.seconds < std::numeric_limits<double>::infinity();
+    clock::time_point deadline;
+    if (timed)
+        deadline = clock::now() + std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>(std::max(limits.seconds, 0.0)));
+
+    output_left = limits.output;
+    u64 left = limits.instructions;
+    status_kind status;
+    while (true) {
+        if (left == 0) {
+            status = STATUS_INSTRUCTION_LIMIT;
+            break;
+        }
+        u64 n = std::min(left, slice);
+        status = run(n);
+        if (status != STATUS_RUNNING) break;
+        left -= n;
+        if (timed && clock::now() >= deadline) {
+            status = STATUS_TIME_LIMIT;
+            break;
+        }
+    }
+    output_left = std::numeric_limits<u64>::max();
+    return status;
+}
+
+status_kind machine::run_jit(u64 n)
+{
+    if (!jit_engine) jit_engine.reset(new jit(*this));
+    return jit_engine->run(n);
+}
+
+status_kind machine::run_aot(u64 n)
+{
+    status_kind status = STATUS_RUNNING;
+    while (n && translation) {
+        n -= translation->run(*this, n);
+        // Once the code has been written over, the interpreter takes over
+        // from the next call.
+        if (!n || !translation) break;
+        status = step();
+        --n;
+        if (status != STATUS_RUNNING || yield) break;
+    }
+    return status;
+}
+
+// Uses computed goto where the compiler supports it, so that each handler ends
+// in its own indirect jump, and falls back to a switch otherwise.
+#if defined(__GNUC__)
+#define LC3_THREADED_DISPATCH 1
+#endif
+
+// Tells observer about every instruction it executes, every BR, the target
+// of every JSR and JSRR, and every register and memory word it writes.
+template <typename Observer>
+status_kind machine::run_interp(u64 n, Observer& observer)
+{
+    const decoded_t* const* const shadow = decoded;
+    u16* const r = registers;
+    u16 pc = program_counter;
+    // The condition codes are only worked out when a BR needs them; until
+    // then this holds the last value that set them.
+    u16 flags = flag_value(condition_register);
+    const bool fusion = this->fusion;
+    u64 remaining = n;
+    status_kind status = STATUS_RUNNING;
+    const decoded_t* d;
+    u64 before;
+
+    // An instruction run again after waiting for input was observed the
+    // first time round, so it starts without DISPATCH.
+#define RESUME() do {                                         \
+        if (waited_at == instructions && remaining) {         \
+            --remaining;                                      \
+            d = &shadow[pc >> page_bits][pc & (page_size - 1)]; \
+            ++pc;                                             \
+            REDISPATCH();                                     \
+        }                                                     \
+    } while (0)
+
+#if LC3_THREADED_DISPATCH
+    static void* const handlers[] = {
+        &&X_DECODE, &&X_BR, &&X_ADD, &&X_ADD_IMM, &&X_LD, &&X_ST, &&X_JSR,
+        &&X_JSRR, &&X_AND, &&X_AND_IMM, &&X_LDR, &&X_STR, &&X_NOT, &&X_LDI,
+        &&X_STI, &&X_JMP, &&X_LEA, &&X_TRAP, &&X_STEP, &&X_ADD_IMM_BR,
+        &&X_LDR_BR,
+    };
+#define HANDLER(x) x:
+#define DISPATCH() do {                                   \
+        if (!remaining) goto done;                        \
+        --remaining;                                      \
+        observer.execute(pc);                             \
+        d = &shadow[pc >> page_bits][pc & (page_size - 1)]; \
+        ++pc;                                             \
+        goto *handlers[d->handler];                       \
+    } while (0)
+#define REDISPATCH() goto *handlers[d->handler]
+    RESUME();
+    DISPATCH();
+#else
+#define HANDLER(x) case x:
+#define DISPATCH() continue
+#define REDISPATCH() goto redispatch
+    RESUME();
+    for (;;) {
+        if (!remaining) goto done;
+        --remaining;
+        observer.execute(pc);
+        d = &shadow[pc >> page_bits][pc & (page_size - 1)];
+        ++pc;
+    redispatch:
+        switch (d->handler) {
+#endif
+
+    HANDLER(X_DECODE) {
+        u16 address = pc - 1;
+        decoded_t* page = decoded_pages[address >> page_bits].get();
+        if (!page) page = make_decoded(address >> page_bits);
+        decoded_t& record = page[address & (page_size - 1)];
+        record = decode(read(address), address);
+        if (fusion) fuse(record, read(address + 1));
+        d = &record;
+    } REDISPATCH();
+
+    HANDLER(X_BR) {
+        bool taken = (d->destination & condition_codes(flags)) != 0;
+        observer.branch(pc - 1, taken);
+        if (taken) pc = d->operand;
+    } DISPATCH();
+
+    HANDLER(X_ADD) {
+        u16& destination = r[d->destination];
+        destination = r[d->source1] + r[d->source2];
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_ADD_IMM) {
+        u16& destination = r[d->destination];
+        destination = r[d->source1] + d->operand;
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_LD) {
+        u16& destination = r[d->destination];
+        destination = read(d->operand);
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_ST) {
+        store(d->operand, r[d->destination]);
+        invalidate(d->operand);
+        observer.write_memory(d->operand, r[d->destination]);
+    } DISPATCH();
+
+    HANDLER(X_JSR) {
+        observer.call(d->operand);
+        r[7] = pc;
+        observer.write_register(7, pc);
+        pc = d->operand;
+    } DISPATCH();
+
+    HANDLER(X_JSRR) {
+        u16 target = r[d->source1];
+        observer.call(target);
+        r[7] = pc;
+        observer.write_register(7, pc);
+        pc = target;
+    } DISPATCH();
+
+    HANDLER(X_AND) {
+        u16& destination = r[d->destination];
+        destination = r[d->source1] & r[d->source2];
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_AND_IMM) {
+        u16& destination = r[d->destination];
+        destination = r[d->source1] & d->operand;
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_LDR) {
+        u16 address = r[d->source1] + d->operand;
+        if (address >= DEVICE_BASE) goto slow;
+        u16& destination = r[d->destination];
+        destination = read(address);
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_STR) {
+        u16 address = r[d->source1] + d->operand;
+        if (address >= DEVICE_BASE) goto slow;
+        store(address, r[d->destination]);
+        invalidate(address);
+        observer.write_memory(address, r[d->destination]);
+    } DISPATCH();
+
+    HANDLER(X_NOT) {
+        u16& destination = r[d->destination];
+        destination = ~r[d->source1];
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_LDI) {
+        u16 address = read(d->operand);
+        if (address >= DEVICE_BASE) goto slow;
+        u16& destination = r[d->destination];
+        destination = read(address);
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_STI) {
+        u16 address = read(d->operand);
+        if (address >= DEVICE_BASE) goto slow;
+        store(address, r[d->destination]);
+        invalidate(address);
+        observer.write_memory(address, r[d->destination]);
+    } DISPATCH();
+
+    HANDLER(X_JMP) {
+        pc = r[d->source1];
+    } DISPATCH();
+
+    HANDLER(X_LEA) {
+        u16& destination = r[d->destination];
+        destination = d->operand;
+        flags = destination;
+        observer.write_register(d->destination, destination);
+    } DISPATCH();
+
+    HANDLER(X_TRAP) {
+        if (os != OS_NONE) goto slow;
+        // The console may want to know how far the program has got.
+        instructions += n - remaining - 1;
+        n = remaining + 1;
+        status = trap(d->operand);
+        if (status != STATUS_RUNNING) {
+            if (status == STATUS_WAITING || status == STATUS_END_OF_INPUT) {
+                --pc;
+                ++remaining;
+                if (observing<Observer>::value) waited_at = instructions;
+            }
+            goto done;
+        }
+        if (d->operand == TRAP_GETC || d->operand == TRAP_IN) observer.write_register(0, r[0]);
+    } DISPATCH();
+
+    // Runs the BR after a fused instruction, unless its record has changed or
+    // the budget ends between the two.
+#define FUSED_BR() do {                                             \
+        const decoded_t* b = &shadow[pc >> page_bits][pc & (page_size - 1)]; \
+        if (b->handler == X_BR && remaining) {                      \
+            --remaining;                                            \
+            observer.execute(pc);                                   \
+            bool taken = (b->destination & condition_codes(flags)) != 0; \
+            observer.branch(pc++, taken);                           \
+            if (taken) pc = b->operand;                             \
+        }                                                           \
+    } while (0)
+
+    HANDLER(X_ADD_IMM_BR) {
+        u16& destination = r[d->destination];
+        destination = r[d->source1] + d->operand;
+        flags = destination;
+        observer.write_register(d->destination, destination);
+        FUSED_BR();
+    } DISPATCH();
+
+    HANDLER(X_LDR_BR) {
+        u16 address = r[d->source1] + d->operand;
+        if (address >= DEVICE_BASE) goto slow;
+        u16& destination = r[d->destination];
+        destination = read(address);
+        flags = destination;
+        observer.write_register(d->destination, destination);
+        FUSED_BR();
+    } DISPATCH();
+#undef FUSED_BR
+
+    HANDLER(X_STEP) {
+    slow:
+        // Device registers, RTI and exceptions are left to step.
+        --pc;
+        ++remaining;
+        program_counter = pc;
+        condition_register = condition_codes(flags);
+        instructions += n - remaining;
+        before = instructions;
+        status = step(observer);
+        remaining -= instructions - before;
+        n = remaining;
+        pc = program_counter;
+        flags = flag_value(condition_register);
+        if (status != STATUS_RUNNING || yield) goto done;
+    } DISPATCH();
+
+#if !LC3_THREADED_DISPATCH
+        }
+    }
+#endif
+#undef HANDLER
+#undef DISPATCH
+#undef REDISPATCH
+#undef RESUME
+
+done:
+    program_counter = pc;
+    condition_register = condition_codes(flags);
+    instructions += n - remaining;
+    return status;
+}
+
+} // namespace lc3
@@ -0,0 +1,201 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include "memory_profile.h"
+
+namespace lc3 {
+
+namespace {
+
+// The number of hottest blocks and addresses listed.
+const std::size_t hot_count = 20;
+
+// Heatmap characters from fewest accesses to most; a space for none.
+const char shades[] = " .:-=+*#%@";
+
+} // namespace
+
+memory_profile::memory_profile(const machine& m) :
+    reads(machine::memory_size),
+    writes(machine::memory_size),
+    m(m),
+    block_stamps(block_count),
+    page_stamps(machine::page_count),
+    seen(block_count)
+{ }
+
+void memory_profile::execute(u16 address)
+{
+    if (++executed > window_end) end_window();
+
+    u16 instruction = m.read(address);
+    u16 next_address = address + 1;
+    switch (instruction >> 12) {
+    case OP_LD:
+        read(next_address + sign_extend_mask(instruction, 9));
+        break;
+    case OP_LDR:
+        read(m.registers[(instruction >> 6) & 0x7] + sign_extend_mask(instruction, 6));
+        break;
+    case OP_LDI:
+    case OP_STI: {
+        u16 pointer = next_address + sign_extend_mask(instruction, 9);
+        read(pointer);
+        if ((instruction >> 12) == OP_LDI) read(m.read(pointer));
+    } break;
+    case OP_TRAP: {
+        u16 vector = instruction & 0xFF;
+        if (vector != TRAP_PUTS && vector != TRAP_PUTSP) break;
+        // Up to and including the terminator, as trap reads it.
+        u16 a = m.registers[0];
+        for (std::size_t i = 0; i != machine::memory_size; ++i, ++a) {
+            read(a);
+            if (!m.read(a)) break;
+        }
+    } break;
+    }
+}
+
+void memory_profile::end_window()
+{
+    next.end = window_end;
+    samples.push_back(next);
+    next = sample_t{0, 0, 0, next.total_blocks};
+    ++current;
+    if (samples.size() == max_samples) {
+        // A merged sample keeps the larger working set of the two.
+        for (std::size_t i = 0; i != max_samples / 2; ++i) {
+            const sample_t& x = samples[2 * i];
+            const sample_t& y = samples[2 * i + 1];
+            samples[i] = sample_t{y.end, std::max(x.blocks, y.blocks),
+                                  std::max(x.pages, y.pages), y.total_blocks};
+        }
+        samples.resize(max_samples / 2);
+        window *= 2;
+    }
+    window_end += window;
+}
+
+bool memory_profile::write_report(const char* filename) const
+{
+    FILE* out = fopen(filename, "w");
+    if (!out) return false;
+
+    std::vector<sample_t> curve = samples;
+    if (next.blocks) {
+        curve.push_back(next);
+        curve.back().end = executed;
+    }
+
+    u64 total_reads = 0;
+    u64 total_writes = 0;
+    std::size_t words = 0;
+    std::vector<u64> blocks(block_count);
+    std::vector<u16> hot;
+    for (std::size_t a = 0; a != machine::memory_size; ++a) {
+        if (!reads[a] && !writes[a]) continue;
+        total_reads += reads[a];
+        total_writes += writes[a];
+        ++words;
+        blocks[a >> block_bits] += reads[a] + writes[a];
+        hot.push_back(static_cast<u16>(a));
+    }
+    const std::size_t columns = machine::page_size / block_size;
+    auto untouched = [](u64 x) { return x == 0; };
+    std::size_t touched_blocks = 0;
+    std::size_t touched_pages = 0;
+    u64 most = 0;
+    for (std::size_t b = 0; b != block_count; ++b) {
+        if (!blocks[b]) continue;
+        ++touched_blocks;
+        most = std::max(most, blocks[b]);
+    }
+    for (std::size_t page = 0; page != machine::page_count; ++page) {
+        const u64* row = &blocks[page * columns];
+        if (!std::all_of(row, row + columns, untouched)) ++touched_pages;
+    }
+    std::size_t largest_blocks = 0;
+    std::size_t largest_pages = 0;
+    for (const sample_t& s : curve) {
+        largest_blocks = std::max(largest_blocks, s.blocks);
+        largest_pages = std::max(largest_pages, s.pages);
+    }
+
+    fprintf(out, "%llu reads and %llu writes in %llu instructions\n",
+            static_cast<unsigned long long>(total_reads),
+            static_cast<unsigned long long>(total_writes),
+            static_cast<unsigned long long>(executed));
+    fprintf(out, "%zu words touched, in %zu blocks of %zu words and %zu pages of %zu words\n",
+            words, touched_blocks, block_size, touched_pages, machine::page_size);
+    fprintf(out, "At most %zu blocks and %zu pages touched in a window of %llu instructions\n",
+            largest_blocks, largest_pages, static_cast<unsigned long long>(window));
+
+    fputs("\nWorking set        instructions   blocks    pages   blocks so far\n"
+          "-----------\n", out);
+    for (const sample_t& s : curve) {
+        fprintf(out, "%32llu %8zu %8zu %15zu\n", static_cast<unsigned long long>(s.end),
+                s.blocks, s.pages, s.total_blocks);
+    }
+
+    fprintf(out, "\nHeatmap: a row per page, a column per block, \"%s\" from none to most\n"
+                 "-------\n", shades);
+    for (std::size_t page = 0; page != machine::page_count; ++page) {
+        const u64* row = &blocks[page * columns];
+        if (std::all_of(row, row + columns, untouched)) continue;
+        char line[columns + 1] = {};
+        for (std::size_t c = 0; c != columns; ++c) {
+            std::size_t shade = 0;
+            if (row[c]) {
+                // On a log scale, from 1 for a single access to the last for
+                // the hottest block.
+                double level = most > 1 ? std::log(double(row[c])) / std::log(double(most)) : 1;
+                shade = 1 + static_cast<std::size_t>(level * (sizeof(shades) - 3) + 0.5);
+            }
+            line[c] = shades[shade];
+        }
+        fprintf(out, "%04x |%s|\n", static_cast<unsigned>(page * machine::page_size), line);
+    }
+
+    std::vector<std::size_t> hot_blocks;
+    for (std::size_t b = 0; b != block_count; ++b) {
+        if (blocks[b]) hot_blocks.push_back(b);
+    }
+    std::size_t shown = std::min(hot_blocks.size(), hot_count);
+    std::partial_sort(hot_blocks.begin(), hot_blocks.begin() + shown, hot_blocks.end(),
+                      [&blocks](std::size_t x, std::size_t y) { return blocks[x] > blocks[y]; });
+    fputs("\nHottest blocks              reads         writes\n"
+          "--------------\n", out);
+    for (std::size_t i = 0; i != shown; ++i) {
+        std::size_t first = hot_blocks[i] * block_size;
+        u64 r = 0;
+        u64 w = 0;
+        for (std::size_t a = first; a != first + block_size; ++a) {
+            r += reads[a];
+            w += writes[a];
+        }
+        fprintf(out, "%04x-%04x %14llu %14llu\n", static_cast<unsigned>(first),
+                static_cast<unsigned>(first + block_size - 1),
+                static_cast<unsigned long long>(r), static_cast<unsigned long long>(w));
+    }
+
+    shown = std::min(hot.size(), hot_count);
+    std::partial_sort(hot.begin(), hot.begin() + shown, hot.end(), [this](u16 x, u16 y) {
+        return reads[x] + writes[x] > reads[y] + writes[y];
+    });
+    fputs("\nHottest addresses           reads         writes\n"
+          "-----------------\n", out);
+    for (std::size_t i = 0; i != shown; ++i) {
+        u16 a = hot[i];
+        fprintf(out, "%04x      %14llu %14llu\n", a, static_cast<unsigned long long>(reads[a]),
+                static_cast<unsigned long long>(writes[a]));
+    }
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    if (!ok && errno == 0) errno = EIO;
+    return ok;
+}
+
+} // namespace lc3
@@ -0,0 +1,142 @@
+#include "machine.h"
+
+namespace lc3 {
+
+namespace {
+
+// The code and constants of the service routines in os/lc3os.asm, as lc3al
+// assembles them. The words each routine saves registers in follow.
+const u16 getc_words[] = {
+    0xA003, 0x07FE, 0xA002, 0xC1C0, 0xFE00, 0xFE02,
+};
+
+const u16 out_words[] = {
+    0x3207, 0xA204, 0x07FE, 0xB003, 0x2203, 0xC1C0, 0xFE04, 0xFE06,
+};
+
+const u16 puts_words[] = {
+    0x300F, 0x320F, 0x340F, 0x6200, 0x0405, 0xA408, 0x07FE, 0xB207,
+    0x1021, 0x0FF9, 0x2005, 0x2205, 0x2405, 0xC1C0, 0xFE04, 0xFE06,
+};
+
+const u16 putsp_words[] = {
+    0x3025, 0x3225, 0x3425, 0x3625, 0x3825, 0x6200, 0x0416, 0x241B,
+    0x5442, 0xA61A, 0x07FE, 0xB419, 0x54A0, 0x5920, 0x1928, 0x1482,
+    0x1260, 0x0601, 0x14A1, 0x1241, 0x193F, 0x03F9, 0x14A0, 0x0403,
+    0xA60B, 0x07FE, 0xB40A, 0x1021, 0x0FE8, 0x2008, 0x2208, 0x2408,
+    0x2608, 0x2808, 0xC1C0, 0x00FF, 0xFE04, 0xFE06,
+};
+
+const u16 halt_words[] = {
+    0x302D, 0x322D, 0x342D, 0xE018, 0x6200, 0x0405, 0xA410, 0x07FE,
+    0xB20F, 0x1021, 0x0FF9, 0x220F, 0xA40A, 0x07FE, 0xB209, 0xA209,
+    0x2009, 0x5040, 0xB006, 0x201A, 0x221A, 0x241A, 0xC1C0, 0xFE04,
+    0xFE06, 0xFFFE, 0x7FFF, 0x000A,
+    '\n', 'p', 'r', 'o', 'g', 'r', 'a', 'm', ' ',
+    'f', 'i', 'n', 'i', 's', 'h', 'e', 'd', 0,
+};
+
+// Where the HALT routine has got to when it stops the clock, counting from
+// its entry.
+const u16 halt_stop = 19;
+
+struct routine_t {
+    u16 vector;
+    const u16* words;
+    u16 size;
+};
+
+#define ROUTINE(vector, words) { vector, words, sizeof(words) / sizeof(words[0]) }
+
+const routine_t routines[] = {
+    ROUTINE(TRAP_GETC, getc_words),
+    ROUTINE(TRAP_OUT, out_words),
+    ROUTINE(TRAP_PUTS, puts_words),
+    ROUTINE(TRAP_PUTSP, putsp_words),
+    ROUTINE(TRAP_HALT, halt_words),
+};
+
+#undef ROUTINE
+
+} // namespace
+
+// Whether the routine for vector at entry is one of ours, word for word.
+bool machine::os_routine(u16 vector, u16 entry, u16& size) const
+{
+    for (const routine_t& r : routines) {
+        if (r.vector != vector) continue;
+        for (u16 i = 0; i != r.size; ++i) {
+            if (read(entry + i) != r.words[i]) return false;
+        }
+        size = r.size;
+        return true;
+    }
+    return false;
+}
+
+// Runs TRAP vector through the trap vector table. With OS_ACCELERATED, a
+// routine that is still the one in os/lc3os.asm is carried out here, leaving
+// registers, condition codes, the words it saves registers in and the
+// devices as the routine itself would on its way back, or as it stops the
+// clock for HALT. Like trap, nothing has happened yet when it returns
+// STATUS_WAITING or STATUS_END_OF_INPUT. The saved_count words from saved on
+// are the ones it saved registers in, for step to report.
+status_kind machine::os_trap(u16 vector, u16& saved, u16& saved_count)
+{
+    u16 entry = read(vector);
+    u16 size;
+    if (os != OS_ACCELERATED || !os_routine(vector, entry, size)) {
+        registers[7] = program_counter;
+        program_counter = entry;
+        return STATUS_RUNNING;
+    }
+
+    u16 slots = entry + size;
+    saved = slots;
+    status_kind status = STATUS_RUNNING;
+    switch (vector) {
+    case TRAP_GETC: {
+        if (!(keyboard_status & DEVICE_READY)) {
+            int c = io->get();
+            if (c == console::empty) return STATUS_WAITING;
+            if (c == EOF) return STATUS_END_OF_INPUT;
+            keyboard_data = static_cast<unsigned char>(c);
+        }
+        keyboard_status &= ~DEVICE_READY;
+        registers[0] = keyboard_data;
+        set_condition_codes(registers[0]);
+    } break;
+    case TRAP_OUT:
+        write(slots, registers[1]);
+        saved_count = 1;
+        set_condition_codes(registers[1]);
+        status = trap(vector);
+        break;
+    case TRAP_PUTS:
+        for (int i = 0; i != 3; ++i) write(slots + i, registers[i]);
+        saved_count = 3;
+        set_condition_codes(registers[2]);
+        status = trap(vector);
+        break;
+    case TRAP_PUTSP:
+        for (int i = 0; i != 5; ++i) write(slots + i, registers[i]);
+        saved_count = 5;
+        set_condition_codes(registers[4]);
+        status = trap(vector);
+        break;
+    case TRAP_HALT:
+        for (int i = 0; i != 3; ++i) write(slots + i, registers[i]);
+        saved_count = 3;
+        registers[7] = program_counter;
+        registers[0] = 0;
+        registers[1] = MCR_CLOCK_ENABLE;
+        registers[2] = display_status;
+        set_condition_codes(0);
+        program_counter = entry + halt_stop;
+        return trap(vector);
+    }
+    registers[7] = program_counter;
+    return status;
+}
+
+} // namespace lc3
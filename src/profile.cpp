@@ -0,0 +1,169 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+#include "profile.h"
+
+namespace lc3 {
+
+namespace {
+
+const char* const opcode_names[] = {
+    "BR", "ADD", "LD", "ST", "JSR", "AND", "LDR", "STR",
+    "RTI", "NOT", "LDI", "STI", "JMP", "(reserved)", "LEA", "TRAP",
+};
+
+// The number of hottest addresses listed on their own.
+const std::size_t hot_count = 20;
+
+bool parse_hex(const std::string& s, std::size_t f, u16& x)
+{
+    if (s.size() < f + 4) return false;
+    x = 0;
+    for (std::size_t i = f; i != f + 4; ++i) {
+        char c = s[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') digit = c - 'A' + 10;
+        else return false;
+        x = static_cast<u16>(x << 4 | digit);
+    }
+    return true;
+}
+
+// What the report needs from a listing file written by lc3al.
+struct listing_t {
+    struct line_t {
+        std::string text;
+        bool has_address;
+        u16 address;
+    };
+    std::vector<line_t> lines;
+    std::map<u16, std::string> source; // the first listed line of each address
+    std::map<u16, std::string> labels;
+
+    void read(const char* filename)
+    {
+        std::ifstream file(filename);
+        std::string text;
+        bool symbols = false;
+        while (std::getline(file, text)) {
+            line_t line{text, false, 0};
+            if (text.compare(0, 12, "Symbol Table") == 0) symbols = true;
+            if (symbols) {
+                // (line) address name
+                std::size_t close = text.find(") ");
+                u16 address;
+                if (!text.empty() && text[0] == '(' && close != std::string::npos
+                    && parse_hex(text, close + 2, address)) {
+                    std::size_t name = text.find(' ', close + 2);
+                    if (name != std::string::npos) labels.emplace(address, text.substr(name + 1));
+                }
+            } else if (text.size() > 10 && text[4] == ' ' && parse_hex(text, 0, line.address)) {
+                line.has_address = true;
+                std::size_t tab = text.find('\t');
+                if (tab != std::string::npos) source.emplace(line.address, text.substr(tab + 1));
+            }
+            lines.push_back(line);
+        }
+    }
+
+    const char* source_of(u16 address) const
+    {
+        auto i = source.find(address);
+        return i == source.end() ? "" : i->second.c_str();
+    }
+
+    const char* label_of(u16 address) const
+    {
+        auto i = labels.find(address);
+        return i == labels.end() ? "" : i->second.c_str();
+    }
+};
+
+double percent(u64 x, u64 total)
+{
+    return total ? 100.0 * static_cast<double>(x) / static_cast<double>(total) : 0.0;
+}
+
+} // namespace
+
+bool profile::write_report(const char* filename, const machine& m,
+                           const char* listing_filename) const
+{
+    FILE* out = fopen(filename, "w");
+    if (!out) return false;
+
+    listing_t listing;
+    if (listing_filename) listing.read(listing_filename);
+
+    u64 total = 0;
+    u64 opcodes[16] = {};
+    std::vector<u16> hot;
+    for (std::size_t a = 0; a != machine::memory_size; ++a) {
+        if (!executed[a]) continue;
+        total += executed[a];
+        opcodes[m.read(static_cast<u16>(a)) >> 12] += executed[a];
+        hot.push_back(static_cast<u16>(a));
+    }
+    auto hotter = [this](u16 x, u16 y) { return executed[x] > executed[y]; };
+    std::size_t shown = std::min(hot.size(), hot_count);
+    std::partial_sort(hot.begin(), hot.begin() + shown, hot.end(), hotter);
+
+    fprintf(out, "%llu instructions executed\n", static_cast<unsigned long long>(total));
+
+    fputs("\nOpcodes\n-------\n", out);
+    for (int op = 0; op != 16; ++op) {
+        if (!opcodes[op]) continue;
+        fprintf(out, "%-10s %14llu %6.2f%%\n", opcode_names[op],
+                static_cast<unsigned long long>(opcodes[op]), percent(opcodes[op], total));
+    }
+
+    fputs("\nHottest addresses\n-----------------\n", out);
+    for (std::size_t i = 0; i != shown; ++i) {
+        u16 a = hot[i];
+        fprintf(out, "%04x %14llu %6.2f%%  %s\n", a,
+                static_cast<unsigned long long>(executed[a]), percent(executed[a], total),
+                listing.source_of(a));
+    }
+
+    fputs("\nBranches            taken      not taken\n"
+          "--------\n", out);
+    for (std::size_t a = 0; a != machine::memory_size; ++a) {
+        if (!taken[a] && !not_taken[a]) continue;
+        fprintf(out, "%04x %14llu %14llu  %s\n", static_cast<unsigned>(a),
+                static_cast<unsigned long long>(taken[a]),
+                static_cast<unsigned long long>(not_taken[a]),
+                listing.source_of(static_cast<u16>(a)));
+    }
+
+    fputs("\nCalls\n-----\n", out);
+    for (std::size_t a = 0; a != machine::memory_size; ++a) {
+        if (!calls[a]) continue;
+        fprintf(out, "%04x %14llu  %s\n", static_cast<unsigned>(a),
+                static_cast<unsigned long long>(calls[a]), listing.label_of(static_cast<u16>(a)));
+    }
+
+    if (!listing.lines.empty()) {
+        fputs("\nListing\n-------\n", out);
+        for (const listing_t::line_t& line : listing.lines) {
+            if (line.has_address && executed[line.address])
+                fprintf(out, "%14llu  %s\n",
+                        static_cast<unsigned long long>(executed[line.address]), line.text.c_str());
+            else
+                fprintf(out, "%14s  %s\n", "", line.text.c_str());
+        }
+    }
+
+    bool ok = !ferror(out);
+    if (fclose(out) != 0) ok = false;
+    if (!ok && errno == 0) errno = EIO;
+    return ok;
+}
+
+} // namespace lc3
@@ -0,0 +1,46 @@
+#include "session.h"
+
+namespace lc3 {
+
+session::session()
+{
+    io.end = console::empty;
+    guest.io = &io;
+}
+
+session::session(const snapshot& x) :
+    guest(x)
+{
+    io.end = console::empty;
+    guest.io = &io;
+}
+
+void session::feed(const char* s, std::size_t n)
+{
+    // Drop what the program has read so that a long session keeps only what
+    // it has yet to.
+    io.input.erase(0, io.position);
+    io.position = 0;
+    io.input.append(s, n);
+}
+
+void session::close()
+{
+    io.end = EOF;
+}
+
+std::string session::take_output()
+{
+    std::string output;
+    output.swap(io.output);
+    return output;
+}
+
+status_kind session::resume(u64 n)
+{
+    if (finished()) return last;
+    last = guest.run(n);
+    return last;
+}
+
+} // namespace lc3
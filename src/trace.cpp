@@ -0,0 +1,267 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include "trace.h"
+
+namespace lc3 {
+
+static const char trace_magic[] = "LC3T";
+// Version 2 added TRACE_TAG_MORE; version 1 traces read the same way.
+static const unsigned char trace_version = 2;
+
+trace_writer::trace_writer() :
+    ring(new unsigned char[chunk_size * chunk_count])
+{ }
+
+trace_writer::~trace_writer()
+{
+    close();
+}
+
+bool trace_writer::open(const char* filename)
+{
+    close();
+    file = fopen(filename, "wb");
+    if (!file) return false;
+
+    head = tail = 0;
+    error = 0;
+    stopping = false;
+    started = false;
+    more.clear();
+    next_address = 0;
+    std::fill(std::begin(registers), std::end(registers), u16(0));
+    last_memory_address = 0;
+    last_input = 0;
+
+    p = ring.get();
+    chunk_end = p + chunk_size;
+    std::memcpy(p, trace_magic, 4);
+    p += 4;
+    *p++ = trace_version;
+    writer = std::thread(&trace_writer::write_chunks, this);
+    return true;
+}
+
+bool trace_writer::close()
+{
+    if (!file) return true;
+    if (started) finish_record();
+    started = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::size_t current = head % chunk_count;
+        filled[current] = static_cast<std::size_t>(p - (ring.get() + current * chunk_size));
+        ++head;
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    int saved = error;
+    if (fclose(file) != 0 && !saved) saved = errno ? errno : EIO;
+    file = nullptr;
+    if (saved) errno = saved;
+    return !saved;
+}
+
+void trace_writer::put_more()
+{
+    put_unsigned(more.size());
+    for (const trace_write_t& w : more) {
+        if (static_cast<std::size_t>(chunk_end - p) < slack) next_chunk();
+        if (w.r == -1) {
+            put_unsigned(8);
+            put_signed(static_cast<u16>(w.address - last_memory_address));
+            put_unsigned(w.value);
+            last_memory_address = w.address;
+        } else {
+            put_unsigned(static_cast<u64>(w.r));
+            u16& last = registers[w.r];
+            put_signed(static_cast<u16>(w.value - last));
+            last = w.value;
+        }
+    }
+    more.clear();
+}
+
+void trace_writer::input(u64 instruction, int c)
+{
+    if (static_cast<std::size_t>(chunk_end - p) < slack) next_chunk();
+    *p++ = TRACE_TAG_INPUT;
+    put_unsigned(instruction - last_input);
+    put_unsigned(c == EOF ? 0 : static_cast<u64>(c) + 1);
+    last_input = instruction;
+}
+
+// Hands the chunk being filled to the writer thread and moves on to the next
+// one, waiting for it to be written out first when the ring is full.
+void trace_writer::next_chunk()
+{
+    std::size_t current = head % chunk_count;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        filled[current] = static_cast<std::size_t>(p - (ring.get() + current * chunk_size));
+        ++head;
+        changed.notify_all();
+        changed.wait(lock, [this] { return head - tail < chunk_count; });
+    }
+    p = ring.get() + head % chunk_count * chunk_size;
+    chunk_end = p + chunk_size;
+}
+
+void trace_writer::write_chunks()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        changed.wait(lock, [this] { return tail != head || stopping; });
+        if (tail == head) return;
+        std::size_t current = tail % chunk_count;
+        lock.unlock();
+        std::size_t n = filled[current];
+        if (!error && fwrite(ring.get() + current * chunk_size, 1, n, file) != n)
+            error = errno ? errno : EIO;
+        lock.lock();
+        ++tail;
+        changed.notify_all();
+    }
+}
+
+bool trace_reader::open(const char* filename)
+{
+    if (!file.open(filename)) return false;
+    p = file.begin();
+    end = file.end();
+    if (file.size() < 5 || std::memcmp(p, trace_magic, 4) != 0 || p[4] == 0 || p[4] > trace_version) {
+        file.close();
+        errno = EINVAL;
+        return false;
+    }
+    p += 5;
+    corrupt = false;
+    count = 0;
+    next_address = 0;
+    std::fill(std::begin(registers), std::end(registers), u16(0));
+    last_memory_address = 0;
+    last_input = 0;
+    return true;
+}
+
+bool trace_reader::get_unsigned(u64& x)
+{
+    x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) return false;
+        unsigned char byte = *p++;
+        x |= static_cast<u64>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+bool trace_reader::get_signed(u16& difference)
+{
+    u64 x;
+    if (!get_unsigned(x)) return false;
+    difference = static_cast<u16>(x >> 1 ^ -(x & 1));
+    return true;
+}
+
+bool trace_reader::get_register(int r, trace_record_t& x)
+{
+    u16 difference;
+    if (!get_signed(difference)) return false;
+    registers[r] = static_cast<u16>(registers[r] + difference);
+    x.writes.push_back(trace_write_t{r, 0, registers[r]});
+    return true;
+}
+
+bool trace_reader::get_memory(trace_record_t& x)
+{
+    u16 difference;
+    u64 value;
+    if (!get_signed(difference) || !get_unsigned(value) || value > 0xFFFF) return false;
+    last_memory_address = static_cast<u16>(last_memory_address + difference);
+    x.writes.push_back(trace_write_t{-1, last_memory_address, static_cast<u16>(value)});
+    return true;
+}
+
+bool trace_reader::next(trace_record_t& x)
+{
+    auto fail = [this] {
+        corrupt = true;
+        return false;
+    };
+    if (p == end) return false;
+    unsigned char tag = *p++;
+    u64 n;
+    u16 difference;
+    x.writes.clear();
+    x.c = 0;
+
+    if (tag == TRACE_TAG_INPUT) {
+        u64 c;
+        if (!get_unsigned(n) || !get_unsigned(c) || c > 0x100) return fail();
+        x.kind = TRACE_INPUT;
+        x.instruction = last_input += n;
+        x.address = next_address;
+        x.c = c == 0 ? EOF : static_cast<int>(c - 1);
+        return true;
+    }
+    if (tag & ~(TRACE_TAG_JUMP | TRACE_TAG_REGISTER | 0x1C | TRACE_TAG_MEMORY | TRACE_TAG_MORE))
+        return fail();
+
+    x.kind = TRACE_INSTRUCTION;
+    x.instruction = count++;
+    x.address = next_address;
+    if (tag & TRACE_TAG_JUMP) {
+        if (!get_signed(difference)) return fail();
+        x.address = static_cast<u16>(x.address + difference);
+    }
+    if (tag & TRACE_TAG_REGISTER) {
+        if (!get_register(tag >> 2 & 0x7, x)) return fail();
+    }
+    if (tag & TRACE_TAG_MEMORY) {
+        if (!get_memory(x)) return fail();
+    }
+    if (tag & TRACE_TAG_MORE) {
+        u64 r;
+        if (!get_unsigned(n) || n == 0) return fail();
+        while (n--) {
+            if (!get_unsigned(r) || r > 8) return fail();
+            if (r == 8 ? !get_memory(x) : !get_register(static_cast<int>(r), x)) return fail();
+        }
+    }
+    next_address = static_cast<u16>(x.address + 1);
+    return true;
+}
+
+bool replay_console::peek()
+{
+    while (!have_input) {
+        if (!trace.next(next_input)) return false;
+        have_input = next_input.kind == TRACE_INPUT;
+    }
+    return true;
+}
+
+int replay_console::get()
+{
+    // Whatever the program printed is most likely a prompt.
+    output.flush();
+    if (!peek()) return EOF;
+    have_input = false;
+    return next_input.c;
+}
+
+int replay_console::try_get()
+{
+    if (!peek()) return EOF;
+    if (next_input.instruction > m.instructions) return empty;
+    have_input = false;
+    return next_input.c;
+}
+
+} // namespace lc3